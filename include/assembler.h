@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "codebuf.h"
+
+using std::string, std::vector;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 REGISTERS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// Registers are typed by width so the assembler can pick the right operand
+// size (and REX prefix) from the arguments alone.
+//
+struct Reg8  { uint8_t id; };
+struct Reg32 { uint8_t id; };
+struct Reg64 {
+    uint8_t id;
+    constexpr Reg32 r32() const { return Reg32{id}; }
+    constexpr Reg8  r8()  const { return Reg8{id}; }
+};
+
+constexpr bool operator==(Reg64 a, Reg64 b) { return a.id == b.id; }
+constexpr bool operator==(Reg32 a, Reg32 b) { return a.id == b.id; }
+constexpr bool operator==(Reg8 a, Reg8 b)   { return a.id == b.id; }
+
+constexpr Reg64 rax{0},  rcx{1},  rdx{2},  rbx{3},  rsp{4},  rbp{5},  rsi{6},  rdi{7};
+constexpr Reg64 r8{8},   r9{9},   r10{10}, r11{11}, r12{12}, r13{13}, r14{14}, r15{15};
+
+constexpr Reg32 eax{0},  ecx{1},  edx{2},  ebx{3},  esp{4},  ebp{5},  esi{6},  edi{7};
+constexpr Reg32 r8d{8},  r9d{9},  r10d{10}, r11d{11}, r12d{12}, r13d{13}, r14d{14}, r15d{15};
+
+constexpr Reg8  al{0},   cl{1},   dl{2},   bl{3};
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 OPERANDS                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+// Memory operand:  [base + index*scale + disp], or [rip + disp32] to an
+// entry of the data segment (disp is then its offset in the segment)
+//
+struct Mem {
+    Reg64 base;
+    int32_t disp = 0;
+    bool has_index = false;
+    Reg64 index{0};
+    uint8_t scale = 1;
+    bool rip = false;
+
+    explicit Mem(Reg64 base, int32_t disp = 0)
+        : base{base}, disp{disp}
+    {}
+
+    Mem(Reg64 base, Reg64 index, uint8_t scale, int32_t disp = 0)
+        : base{base}, disp{disp}, has_index{true}, index{index}, scale{scale}
+    {}
+
+    // (rbp's encoding with mod 00 is what means rip)
+    static Mem data(int32_t offset)
+    {
+        Mem mem{rbp, offset};
+        mem.rip = true;
+        return mem;
+    }
+};
+
+// Condition codes, in x86 encoding order (jcc = 0x70 + cc, setcc = 0x0f 0x90 + cc)
+//
+enum class Cond : uint8_t {
+    O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G,
+    Z = E, NZ = NE
+};
+
+// flip a condition (the low bit of the encoding is the negation bit)
+constexpr Cond invert(Cond cc)
+{
+    return static_cast<Cond>(static_cast<uint8_t>(cc) ^ 1);
+}
+
+// Jump target. Labels can be jumped to before they are bound, the
+// displacement is filled in by the layout pass in finalize().
+//
+struct Label {
+    int id = -1;
+};
+
+// One record per emitted instruction, in emit order. The peephole pass
+// matches its patterns against these (never against raw bytes) and runs a
+// register liveness pass over them using the use / def masks.
+//
+enum InsnOp : uint8_t {
+    OP_OTHER,
+    OP_MOV_RR,      // mov dst, src
+    OP_MOV_RI,      // mov dst, imm
+    OP_LOAD,        // mov dst, [src + disp]
+    OP_STORE,       // mov [dst + disp], src
+    OP_PUSH,        // push src
+    OP_POP,         // pop dst
+    OP_ALU_RR,      // (alu) dst, src
+    OP_ALU_RI,      // (alu) dst, imm
+    OP_CMP_RR,      // cmp dst, src
+    OP_CMP_RI,      // cmp dst, imm
+    OP_SETCC,       // setcc dst
+    OP_MOVZX,       // movzx dst, src (byte)
+    OP_JMP,
+    OP_JCC,
+    OP_CALL,
+    OP_RET
+};
+
+enum AluOp : uint8_t {
+    ALU_ADD, ALU_SUB, ALU_AND, ALU_OR, ALU_XOR, ALU_IMUL
+};
+
+// use / def masks: bit n is register n, FLAGS_BIT is rflags
+constexpr uint32_t FLAGS_BIT = 1u << 16;
+constexpr uint32_t reg_bit(uint8_t id) { return 1u << id; }
+
+struct Insn {
+    size_t pos = 0;         // offset as emitted
+    uint8_t len = 0;
+    InsnOp op = OP_OTHER;
+    bool wide = true;       // 64-bit operand size
+    AluOp alu = ALU_ADD;
+    uint8_t dst = 0, src = 0;
+    int64_t imm = 0;        // immediate, or memory displacement
+    bool indexed = false;   // memory operand has an index register
+    bool rip = false;       // memory operand is a data segment entry (imm: its offset)
+    uint32_t uses = 0, defs = 0;
+};
+
+// What the peephole pass did, per pattern (--opt-report)
+//
+struct PeepholeStat {
+    string name;
+    unsigned hits = 0;
+    unsigned insns_removed = 0;
+    size_t bytes_removed = 0;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 ASSEMBLER                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+class Assembler {
+public:
+    Assembler(CodeBuffer&);
+
+    // labels
+    Label new_label();
+    void bind(Label);
+
+    size_t offset() const { return code.offset(); }
+
+    // pad (with nops, at layout time) so the next instruction starts on a
+    // multiple of `boundary` bytes
+    void align(unsigned boundary);
+
+    // loop heads get aligned only when enabled (--align-loops)
+    void set_loop_align(unsigned boundary) { loop_align = boundary; }
+    void align_loop() { align(loop_align); }
+
+    // the peephole pass runs in finalize(), before layout, when enabled
+    void set_peephole(bool enable) { peephole_enabled = enable; }
+    const vector<PeepholeStat>& peephole_report() const { return peephole_stats; }
+
+    // run the peephole & layout passes (branch relaxation, alignment) and
+    // finalize the code buffer
+    void finalize();
+
+    // offset emitted at -> final offset after layout
+    size_t map_offset(size_t) const;
+
+    // Remember the current position (unlike a label, nothing jumps to it, so
+    // the peephole pass can still work across it) - its final offset is
+    // mark_offset(id) after finalize()
+    int mark();
+    size_t mark_offset(int id) const { return map_offset(marks[id]); }
+
+    // n bytes of the data segment, for Mem::data (see CodeBuffer)
+    int32_t add_data(size_t n, size_t align, const void* init = nullptr);
+
+    // data movement
+    void mov(Reg64, Reg64);
+    void mov(Reg32, Reg32);
+    void mov(Reg64, int64_t);     // shortest of mov r32 / mov r64 simm32 / movabs
+    void mov(Reg32, int32_t);
+    void mov(Reg32, const Mem&);  // load
+    void mov(Reg64, const Mem&);
+    void mov(const Mem&, Reg32);  // store
+    void mov(const Mem&, Reg64);
+    void mov(const Mem&, int32_t);  // dword store of an immediate
+    void movsx(Reg64, Reg8);
+    void movzx(Reg32, Reg8);
+    void movsxd(Reg64, Reg32);
+    void lea(Reg64, const Mem&);
+    void lea(Reg32, const Mem&);
+    void push(Reg64);
+    void pop(Reg64);
+
+    // arithmetic / logic
+    void add(Reg64, Reg64);
+    void add(Reg64, int32_t);
+    void add(Reg32, Reg32);
+    void add(Reg32, int32_t);
+    void sub(Reg64, Reg64);
+    void sub(Reg64, int32_t);
+    void sub(Reg32, Reg32);
+    void sub(Reg32, int32_t);
+    void and_(Reg64, Reg64);
+    void and_(Reg64, int32_t);
+    void and_(Reg32, Reg32);
+    void and_(Reg32, int32_t);
+    void or_(Reg64, Reg64);
+    void or_(Reg32, Reg32);
+    void xor_(Reg64, Reg64);
+    void xor_(Reg32, Reg32);
+    void xor_(Reg8, uint8_t);
+    void cmp(Reg64, Reg64);
+    void cmp(Reg32, Reg32);
+    void cmp(Reg32, int32_t);
+    void test(Reg64, Reg64);
+    void test(Reg32, Reg32);
+    void test(Reg32, int32_t);
+    void test(Reg8, uint8_t);
+    void imul(Reg64, Reg64);
+    void imul(Reg64, Reg64, int32_t);
+    void imul(Reg32, Reg32);
+    void imul(Reg32, Reg32, int32_t);
+    void idiv(Reg64);
+    void idiv(Reg32);
+    void cqo();
+    void cdq();
+    void neg(Reg64);
+    void neg(Reg32);
+    void inc(Reg32);
+    void inc(const Mem&);           // qword
+    void shl(Reg64, uint8_t);
+    void shl(Reg32, uint8_t);
+    void sar(Reg64, uint8_t);
+    void sar(Reg32, uint8_t);
+    void shr(Reg64, uint8_t);
+    void shr(Reg32, uint8_t);
+    void setcc(Cond, Reg8);
+
+    // control flow
+    void jmp(Label);
+    void jcc(Cond, Label);
+    void call(Reg64);
+    void call(const void* helper);  // direct, through a trampoline
+    void ret();
+
+private:
+    CodeBuffer& code;
+
+    // bound position of each label (-1 while unbound)
+    vector<long> labels;
+
+    // position of each mark
+    vector<long> marks;
+
+    unsigned loop_align = 0;
+
+    // A rel32 only known once the final layout is: a [rip + disp32] data
+    // reference, or a direct call to a runtime helper's trampoline. The
+    // trampolines (jmp [rip] ; dq helper) go after the code, in reach of
+    // every call, & the helper can be anywhere.
+    struct Reloc {
+        size_t pos;             // of the rel32
+        uint8_t tail;           // instruction bytes after it (an immediate)
+        bool call;
+        int32_t target;         // trampoline index / data segment offset
+    };
+    vector<Reloc> relocs;
+    vector<intptr_t> helpers;   // one trampoline each
+
+    void emit_trampolines(vector<size_t>& at);
+
+    // instruction records (see Insn) & the peephole pass over them
+    vector<Insn> insns;
+    bool peephole_enabled = false;
+    vector<PeepholeStat> peephole_stats;
+
+    void note(Insn);
+    void peephole();
+    uint32_t mem_uses(const Mem&) const;
+
+    // Everything whose final size depends on where things end up: every
+    // branch (rel8 vs rel32) and every alignment point. Recorded in emit
+    // order, so the list is sorted by position.
+    enum LayoutKind : uint8_t {
+        LAYOUT_JMP,
+        LAYOUT_JCC,
+        LAYOUT_ALIGN
+    };
+
+    struct LayoutItem {
+        size_t pos;             // offset as emitted
+        uint8_t old_len;        // size as emitted
+        uint8_t new_len;        // size after layout
+        LayoutKind kind;
+        Cond cc;
+        Label target;
+        unsigned align;
+        long delta_before = 0;  // total size change of the items before this one
+    };
+    vector<LayoutItem> layout_items;
+    long layout_delta = 0;      // total size change of all items
+
+    void layout();
+    static size_t near_len(LayoutKind);
+
+    // encoding helpers
+    void rex(bool w, uint8_t reg, uint8_t index, uint8_t rm, bool force = false);
+    void modrm_reg(uint8_t reg, uint8_t rm);
+    void modrm_mem(uint8_t reg, const Mem&);
+    void op_rr(bool w, uint8_t opcode, uint8_t reg, uint8_t rm);
+    void op_rm(bool w, uint8_t opcode, uint8_t reg, const Mem&);
+    void alu_ri(bool w, uint8_t ext, uint8_t rm, int32_t imm);
+    void arith_rr(bool w, AluOp, uint8_t dst, uint8_t src);
+    void arith_ri(bool w, AluOp, uint8_t dst, int32_t imm);
+    void shift_ri(bool w, uint8_t ext, uint8_t rm, uint8_t imm);
+    void branch(LayoutKind, Cond, Label);
+    void put_branch(LayoutKind, Cond, bool is_short, long disp);
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "assembler.h"
+#include "ir.h"
+#include "regalloc.h"
+
+using std::vector;
+
+// x86-64 code for an IR function
+//
+// Registers come from the RegAllocator. Blocks are emitted in layout order
+// (a branch to the next block is left out), PHIs turn into moves at the
+// end of each pred, & CONSTs are folded into the instructions using them
+// as immediates wherever x86 has the form. A compare feeding only the
+// branch after it becomes cmp + jcc, with no 0 / 1 value in between.
+// Variables live in the data segment, addressed [rip + disp32] (so do the
+// --instrument counters, one inc each), & runtime helpers are direct
+// calls. A print statement is one call, taking a descriptor of its
+// arguments built here (see PrintDesc).
+//
+// With strength reduction on (stats given), multiplies by a constant use
+// lea / shift / add when that's at most two steps, division / mod by a
+// power of two use shifts & masks, & by any other constant a multiply by
+// its magic number.
+//
+// Where the code from a source position starts: from this mark to the
+// next one, the code came from line:col, in fn.regions[region] (line 0
+// for the prologue, & the end mark has line -1)
+//
+struct SourceMark {
+    int mark;       // Assembler::mark
+    int line, col;
+    int region;
+};
+
+class Backend {
+public:
+    Backend(const IrFunction&, Assembler&, StrengthStats* reduce = nullptr);
+
+    void emit();
+
+    const vector<SourceMark>& source_marks() const { return marks; }
+
+    // data segment offset of the execution counters (fn.counters, a
+    // uint64_t each)
+    int32_t counters_offset() const { return counter_data; }
+
+private:
+    const IrFunction& fn;
+    Assembler& as;
+    RegAllocator regs;
+    StrengthStats* reduce;
+
+    vector<Label> labels;
+    int next_block = -1;            // the block emitted after this one
+    int frame = 0;                  // stack bytes below the saved registers
+    Cond flags = Cond::NE;          // what the last CMP left in the flags means
+
+    // data segment offsets of the variables
+    vector<int32_t> var_data;
+    int32_t counter_data = 0;
+
+    vector<SourceMark> marks;
+
+    const Location& loc(int vreg) const { return regs.location(vreg); }
+    bool is_const(int vreg) const { return loc(vreg).kind == Location::CONST; }
+    int32_t const_value(int vreg) const { return static_cast<int32_t>(loc(vreg).imm); }
+    Mem slot(const Location& l) const { return Mem(rsp, 8 * l.slot); }
+    Mem var(int index) const { return Mem::data(var_data[index]); }
+
+    void load(Reg32, int vreg);
+    void load64(Reg64, int vreg);
+    Reg32 use(int vreg, Reg32 scratch);
+    Reg32 def(int vreg, Reg32 scratch);
+    void commit(int vreg, Reg32);
+
+    void move(const Location& dst, const Location& src, bool wide);
+    void phi_moves(int from, int to);
+    void jump_to(int from, int to);
+
+    void prologue();
+    void epilogue();
+
+    void emit_inst(int block, const IrInst&);
+    void emit_arith(const IrInst&);
+    void emit_div(const IrInst&);
+    bool mul_by_const(Reg32 dst, Reg32 src, int32_t);
+    bool div_by_pow2(const IrInst&);
+    bool div_by_magic(const IrInst&);
+    void emit_pow(const IrInst&);
+    void emit_cmp(const IrInst&);
+    void emit_print(const IrInst&);
+    void emit_call(intptr_t helper);
+};
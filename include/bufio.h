@@ -24,4 +24,7 @@ int buf_get_next_char(char&);
 bool buf_eof();
 
 // get line
-string buf_getline(int);
\ No newline at end of file
+string buf_getline(int);
+
+// get number of lines
+int buf_line_count();
\ No newline at end of file
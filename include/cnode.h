@@ -1,14 +1,18 @@
 #ifndef CNODE_H
 #define CNODE_H
 
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 #include <variant>
 
+#include "ir.h"
 #include "tables.h"
 
-using std::string, std::vector, std::unique_ptr;
+using std::map, std::set, std::string, std::vector, std::unique_ptr;
 
 //using ValueType = std::variant<int32_t, string>;
 
@@ -57,14 +61,50 @@ enum CNodeType {
     CNODE_VAR
 };
 
+// Constant folding state: the variables known to hold a constant at the
+// current point of the walk, & counts of what was done (--opt-report)
+//
+struct FoldState {
+    map<string, int32_t> vars;
+    unsigned folded = 0;        // constant subtrees replaced by a literal
+    unsigned propagated = 0;    // variable uses replaced by the variable's value
+    unsigned branches = 0;      // ifs & whiles with a constant condition
+};
+
+class CNode;
+
+// fold the tree in place - runs between parsing & IR lowering
+void fold_constants(unique_ptr<CNode>&, FoldState&);
+
 // CNode
 //
+// Statements lower themselves to IR with gen_ir. Expressions lower with
+// gen_ir_value, which returns the vreg holding the value. A condition (of
+// an if / while, or an operand of & / |) lowers with gen_ir_cond instead,
+// straight into branches to the true & false blocks - no 0 / 1 value.
+//
+// fold returns the node to put in this one's place (nullptr to keep it).
+//
+// A statement knows the source line & column it starts at (0 for anything
+// else).
+//
 class CNode {
 public:
     virtual ~CNode() = default;
+    void set_position(int l, int c) { line = l; col = c; }
+    int get_line() const { return line; }
+    int get_col() const { return col; }
     virtual void print(int) const;
-    virtual void gen_node_code(char*&, int&, SymbolTable&) = 0;
+    virtual void gen_ir(IrBuilder&);
+    virtual int gen_ir_value(IrBuilder&);
+    virtual void gen_ir_cond(IrBuilder&, int if_true, int if_false);
+    virtual unique_ptr<CNode> fold(FoldState&);
+    virtual void assigned_vars(set<string>&) const;
     virtual CNodeType get_node_type() const = 0;
+
+protected:
+    int line = 0;
+    int col = 0;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -80,7 +120,9 @@ private:
 public:
     StatementBlockNode(vector<unique_ptr<CNode>>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -101,7 +143,8 @@ public:
     PrintNode(vector<unique_ptr<CNode>>);
 
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
     CNodeType get_node_type() const override;
 };
 
@@ -116,7 +159,9 @@ private:
 public:
     ReadNode(unique_ptr<CNode>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -129,7 +174,9 @@ private:
 public:
     IfNode(unique_ptr<CNode>, unique_ptr<CNode>, unique_ptr<CNode>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -142,7 +189,9 @@ private:
 public:
     ElseNode(unique_ptr<CNode>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -155,7 +204,9 @@ private:
 public:
     WhileNode(unique_ptr<CNode>, unique_ptr<CNode>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -171,7 +222,9 @@ private:
 public:
     VarDeclareNode(string);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -187,7 +240,9 @@ private:
 public:
     VarAssignNode(string, unique_ptr<CNode>);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    void gen_ir(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
+    void assigned_vars(set<string>&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -197,14 +252,19 @@ public:
 
 // Binary Expressions
 //
+// fold: both sides are folded, then evaluate() computes the value when
+// they both came out as literals (false: leave it for run time)
+//
 class BinaryExpr : public CNode {
 public:
     BinaryExpr(unique_ptr<CNode>, unique_ptr<CNode>);
     void print(int) const override;
+    unique_ptr<CNode> fold(FoldState&) override;
 
 protected:
     unique_ptr<CNode> left_expr, right_expr;
-    void gen_left_right_code(char*&, int&, SymbolTable&);
+    int gen_arith_ir(IrBuilder&, IrOp);
+    virtual bool evaluate(int32_t, int32_t, int32_t&) const;
 };
 
 // Unary Expressions
@@ -213,10 +273,11 @@ class UnaryExpr : public CNode {
 public:
     UnaryExpr(unique_ptr<CNode>);
     void print(int) const override;
+    unique_ptr<CNode> fold(FoldState&) override;
 
 protected:
     unique_ptr<CNode> val_expr;
-    void gen_val_code(char*&, int&, SymbolTable&);
+    virtual bool evaluate(int32_t, int32_t&) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -228,7 +289,9 @@ protected:
 class OrNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    void gen_ir_cond(IrBuilder&, int if_true, int if_false) override;
+    unique_ptr<CNode> fold(FoldState&) override;
     CNodeType get_node_type() const override;
 };
 
@@ -237,7 +300,9 @@ public:
 class AndNode: public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    void gen_ir_cond(IrBuilder&, int if_true, int if_false) override;
+    unique_ptr<CNode> fold(FoldState&) override;
     CNodeType get_node_type() const override;
 };
 
@@ -246,7 +311,9 @@ public:
 class NotNode : public UnaryExpr {
 public:
     using UnaryExpr::UnaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    void gen_ir_cond(IrBuilder&, int if_true, int if_false) override;
+    bool evaluate(int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -269,7 +336,8 @@ private:
 
 public:
     RelateExprNode(unique_ptr<CNode>, unique_ptr<CNode>, RelateExprType);
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -282,7 +350,8 @@ public:
 class AddNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -292,7 +361,8 @@ public:
 class SubtractNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -302,7 +372,8 @@ public:
 class MultiplyNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -312,7 +383,8 @@ public:
 class DivideNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -322,7 +394,8 @@ public:
 class ModNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -332,7 +405,8 @@ public:
 class PowerNode : public BinaryExpr {
 public:
     using BinaryExpr::BinaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -342,7 +416,8 @@ public:
 class NegativeNode : public UnaryExpr {
 public:
     using UnaryExpr::UnaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -352,7 +427,8 @@ public:
 class PositiveNode : public UnaryExpr {
 public:
     using UnaryExpr::UnaryExpr;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    bool evaluate(int32_t, int32_t&) const override;
     CNodeType get_node_type() const override;
 };
 
@@ -368,8 +444,9 @@ private:
 
 public:
     IntegerNode(long long int);
+    long long int get_value() const;
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
     CNodeType get_node_type() const override;
 };
 
@@ -383,7 +460,7 @@ private:
 public:
     StringNode(char*);
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
     CNodeType get_node_type() const override;
 };
 
@@ -396,8 +473,10 @@ private:
 
 public:
     BoolNode(bool);
+    bool get_value() const;
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    void gen_ir_cond(IrBuilder&, int if_true, int if_false) override;
     CNodeType get_node_type() const override;
 };
 
@@ -410,8 +489,10 @@ private:
 
 public:
     VariableNode(string);
+    const string& get_name() const;
     void print(int) const override;
-    void gen_node_code(char*&, int&, SymbolTable&) override;
+    int gen_ir_value(IrBuilder&) override;
+    unique_ptr<CNode> fold(FoldState&) override;
     CNodeType get_node_type() const override;
 };
 
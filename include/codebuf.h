@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using std::array, std::vector;
+
+// CodeBuffer
+//
+// Executable memory region that generated code is emitted into. The region
+// starts small and grows geometrically (mremap) whenever an emit would run
+// past the end, so code size is only bounded by available memory. Everything
+// that refers back into the buffer (jump patches etc.) uses offsets, never
+// raw pointers, so it's fine for the mapping to move while growing.
+//
+// The region is never writable and executable at the same time (W^X). It is
+// backed by a memfd that every emit and patch goes through (a read/write
+// view). finalize() maps the same pages read/exec, with the data segment
+// mapped read/write right below them - variables & constants the code
+// addresses [rip + disp32], always in reach:
+//
+//   [ data (rw) | code (rx) ]
+//
+class CodeBuffer {
+public:
+    CodeBuffer(size_t initial_capacity = 4096);
+    ~CodeBuffer();
+
+    CodeBuffer(const CodeBuffer&) = delete;
+    CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+    // make room for (at least) n more bytes
+    void reserve(size_t n)
+    {
+        if (size + n > capacity) {
+            grow(size + n);
+        }
+    }
+
+    // emit primitives - each one checks capacity first
+    void emit8(uint8_t byte)
+    {
+        reserve(1);
+        prog[size++] = byte;
+    }
+
+    void emit32(uint32_t val)
+    {
+        reserve(4);
+        std::memcpy(&prog[size], &val, 4);
+        size += 4;
+    }
+
+    void emit64(uint64_t val)
+    {
+        reserve(8);
+        std::memcpy(&prog[size], &val, 8);
+        size += 8;
+    }
+
+    void emit(const uint8_t* bytes, size_t n)
+    {
+        reserve(n);
+        std::memcpy(&prog[size], bytes, n);
+        size += n;
+    }
+
+    template<size_t N>
+    void emit(const array<uint8_t, N>& code)
+    {
+        reserve(N);
+        std::memcpy(&prog[size], code.data(), N);
+        size += N;
+    }
+
+    // unchecked variants - only valid for bytes covered by a prior reserve()
+    void put8(uint8_t byte)
+    {
+        prog[size++] = byte;
+    }
+
+    void put32(uint32_t val)
+    {
+        std::memcpy(&prog[size], &val, 4);
+        size += 4;
+    }
+
+    void put64(uint64_t val)
+    {
+        std::memcpy(&prog[size], &val, 8);
+        size += 8;
+    }
+
+    // overwrite 4 bytes at an already emitted offset (jump back-patching)
+    void patch32(size_t at, int32_t val)
+    {
+        std::memcpy(&prog[at], &val, 4);
+    }
+
+    // drop everything emitted past offset `at`
+    void truncate(size_t at)
+    {
+        size = at;
+    }
+
+    // n bytes of the data segment (zeroed, or copied from init), aligned to
+    // `align` - returns its offset in the segment
+    size_t add_data(size_t n, size_t align, const void* init = nullptr);
+
+    // where data segment offset `at` ends up, relative to the start of the
+    // code (negative - the segment is below it)
+    long data_offset(size_t at) const;
+
+    // done emitting - records the final code size & maps the code & data
+    // for running
+    void finalize();
+
+    // the data segment back to what it was at finalize (between runs)
+    void reset_data();
+
+    size_t offset() const { return size; }
+    size_t code_size() const { return final_size; }
+    uint8_t* data() const { return prog; }
+    const uint8_t* exec_data() const { return exec; }
+    uint8_t* data_segment() const { return data_view; }
+    size_t data_size() const { return data_init.size(); }
+
+private:
+    int fd;
+    uint8_t* prog;   // writable view
+    uint8_t* exec = nullptr;        // executable view (after finalize)
+    uint8_t* data_view = nullptr;   //   & the data segment below it
+    size_t size = 0;
+    size_t capacity;
+    size_t final_size = 0;
+
+    vector<uint8_t> data_init;      // data segment contents until finalize
+    size_t data_pages = 0;          // bytes mapped for it
+
+    void grow(size_t);
+};
@@ -1,26 +1,70 @@
 #pragma once
 
+#include <cstdint>
 #include <variant>
+#include <vector>
 
+#include "assembler.h"
+#include "codebuf.h"
 #include "parser.h"
 #include "cnode.h"
 #include "tables.h"
+#include "options.h"
+#include "counters.h"
+#include "jitsyms.h"
+#include "profiler.h"
 
-using std::variant;
+using std::variant, std::vector;
+
+// how long one phase of generate() took (& what it counted, --counters)
+struct PhaseTime {
+    const char* name;
+    uint64_t ns;
+    CounterValues counters;
+};
 
 class Codegen {
 public:
     using ValueType = variant<string, uint32_t>;
 
-    Codegen(Parser&, SymbolTable&);
-    ~Codegen();
+    Codegen(Parser&, SymbolTable&, const Options&);
 
     void generate(unique_ptr<CNode>);
     void run();
 
 private:
+    void print_opt_report() const;
+
+    // --bench: run the code `runs` times & report the timings
+    void bench(unsigned runs, Profiler*);
+
+    // --counters: the compile phases, & the run unless it's null
+    void print_counter_report(const CounterValues* program) const;
+
+    // --instrument: the source listed with what the counters counted (the
+    // last run's), & the counts file
+    void report_counts() const;
+
     Parser& parser;
     SymbolTable& symtbl;
-    char* prog;
-    int p_offset = 0;
+    const Options& opts;
+    CodeBuffer code;
+    Assembler as{code};
+    FoldState fold_stats;
+    StrengthStats strength_stats;
+    DceStats dce_stats;
+    unsigned hoisted = 0;
+    ProfileStats profile_stats;
+    vector<PhaseTime> phases;
+    PerfCounters counters;
+
+    // where each stretch of the final code came from
+    vector<SourceRange> source_ranges;
+    vector<IrRegion> regions;
+    vector<LineEntry> lines;
+
+    // --instrument
+    vector<IrCounter> exec_counters;
+    vector<IrCounted> counted_statements;
+    int32_t counters_offset = 0;
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string, std::vector;
+
+// Performance counters
+//
+// perf_event_open counters on this thread, user space only (the generated
+// code & the runtime it calls, or the compiler between two phases). They
+// are opened in groups that count together - the hardware ones in two
+// groups small enough for the PMU to schedule at once, & a software group
+// that works even without one (in a VM, say). An event the kernel or CPU
+// doesn't have is left out; a group whose leader can't be opened is
+// dropped. Nothing open at all just means every value reads as missing.
+//
+enum Counter {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    L1D_MISSES,
+    L1I_MISSES,
+    ITLB_MISSES,
+    TASK_CLOCK,
+    PAGE_FAULTS,
+    COUNTER_COUNT
+};
+
+const char* counter_name(Counter);
+
+struct CounterValues {
+    uint64_t value[COUNTER_COUNT] = {};
+    bool valid[COUNTER_COUNT] = {};
+
+    // instructions per cycle (0 without both)
+    double ipc() const;
+};
+
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // open every group it can - false if none (error() has why the first
+    // one that failed did)
+    bool open();
+    bool available() const { return !groups.empty(); }
+    const string& error() const { return open_error; }
+
+    // zero & start counting / stop & read (scaled up if the kernel had to
+    // multiplex a group)
+    void start();
+    CounterValues stop();
+
+private:
+    struct Group {
+        int leader;
+        vector<int> fds;
+        vector<Counter> counters;   // in read order
+    };
+
+    vector<Group> groups;
+    string open_error;
+};
+
+// print one set of values (summary lines), or as a JSON object
+void print_counters(const CounterValues&, const string& indent);
+void print_counters_json(const CounterValues&);
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tables.h"
+
+using std::map, std::string, std::vector;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                    IR                                     //
+///////////////////////////////////////////////////////////////////////////////
+
+// SSA form mid-level IR
+//
+// A function is a list of basic blocks. Every instruction that produces a
+// value defines a fresh virtual register (vreg), & each vreg has a type.
+// Program variables stay in memory (LOADVAR / STOREVAR) until a pass
+// promotes them - the promoted values then flow through PHIs.
+//
+// Every block ends with exactly one terminator (BR, CBR or RET). Branch
+// targets live in the block's succs, & a PHI has one argument per entry
+// in the block's preds, in the same order.
+//
+
+enum class IrType : uint8_t {
+    VOID,
+    I32,
+    BOOL,
+    STR
+};
+
+enum class IrOp : uint8_t {
+    CONST,      // dst = imm                       (STR: imm is the string's address)
+    LOADVAR,    // dst = var[imm]
+    STOREVAR,   // var[imm] = args[0]
+    ADD,        // dst = args[0] + args[1]
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    POW,
+    NEG,        // dst = -args[0]
+    CMP,        // dst = args[0] (imm: IrCmp) args[1]
+    NOT,        // dst = !args[0]
+    PHI,        // dst = args[i] coming from preds[i]
+    COPY,       // dst = args[0]
+    PRINT,      // print each of args, in order (by its type)
+    READ,       // dst = integer read from input
+    BR,         // goto succs[0]
+    CBR,        // if args[0] goto succs[0] else goto succs[1]
+    RET,
+    COUNT       // counters[imm] += 1              (--instrument)
+};
+
+enum class IrCmp : uint8_t {
+    LT, LE, GT, GE, EQ, NE
+};
+
+struct IrInst {
+    IrOp op;
+    int dst = -1;
+    vector<int> args;
+    int64_t imm = 0;
+
+    // where it came from: its statement's line:col & its IrRegion (0 / -1
+    // for what a pass added without one - it goes with the code before it)
+    int line = 0;
+    int col = 0;
+    int region = -1;
+};
+
+struct IrBlock {
+    vector<IrInst> insts;
+    vector<int> preds, succs;
+};
+
+// A variable (the backend gives it storage in the data segment)
+struct IrVar {
+    string name;
+};
+
+// Code is grouped by where it came from, for perf symbols: each top level
+// statement is a region, & so is each while loop's body (everything in it,
+// down to the next loop body in).
+struct IrRegion {
+    int line;           // of the statement / of the while
+    bool loop_body;
+};
+
+// Execution counters (--instrument). There are no jumps out of a block of
+// statements (no break, no return), so every statement in one runs as
+// often as the block is entered: only the program's entry, each if arm &
+// each loop's back edge need a counter. Every statement is counted by the
+// counter of the innermost of those it's in.
+enum class IrCounterKind : uint8_t {
+    ENTRY,      // the program, once
+    THEN,       // an if's arms (line:col of the if)
+    ELSE,
+    LOOP        // a while's back edge - its body's runs (line:col of the while)
+};
+
+struct IrCounter {
+    IrCounterKind kind;
+    int line, col;
+};
+
+// a statement, & the counter its count is
+struct IrCounted {
+    int line, col;
+    int counter;
+};
+
+// A while loop, as lowered:
+//
+//   preheader:  ... br header
+//   header..:   condition, cbr body / exit
+//   body..:     ... br header
+//   exit:
+//
+// Blocks are numbered in creation order, so the loop is every block in
+// [header, end) except the exit. An unrolled loop (--profile-use) has more
+// copies of the body after the first, each after its own condition test
+// (cbr next copy / exit) - only the last one branches back to the header.
+//
+struct IrLoop {
+    int preheader, header, exit, end;
+    int depth;      // 1 for an outermost loop
+    int line, col;  // of the while
+    unsigned align; // the header's alignment, 0: the default (--align-loops)
+
+    bool contains(int b) const { return b >= header && b < end && b != exit; }
+};
+
+// An if arm the profile says is rarely run (--profile-use): the blocks in
+// the layout from its entry up to `after` (the next arm, or the block
+// after the if) go to the end of the code.
+struct IrColdArm {
+    int entry, after;
+};
+
+struct IrFunction {
+    vector<IrBlock> blocks;
+    vector<int> layout;         // block emit order
+    vector<IrType> vregs;       // type of each vreg
+    vector<IrVar> vars;
+    vector<IrLoop> loops;       // outer loops before the loops they contain
+    vector<IrRegion> regions;
+    vector<IrCounter> counters;
+    vector<IrCounted> counted;
+    vector<IrColdArm> cold_arms;
+
+    int new_vreg(IrType);
+    int new_block();
+    void add_edge(int from, int to);
+};
+
+const char* ir_op_name(IrOp);
+const char* ir_type_name(IrType);
+const char* ir_cmp_name(IrCmp);
+const char* ir_counter_kind_name(IrCounterKind);
+bool ir_is_terminator(IrOp);
+
+// Execution counts from an --instrument run's counts file (--profile-use),
+// by the line:col of the statement / of the if or while they're for
+struct IrProfile {
+    using Position = std::pair<int, int>;
+
+    map<Position, uint64_t> statements;
+    map<Position, uint64_t> then_arms, else_arms;
+    map<Position, uint64_t> loop_bodies;
+};
+
+// false (after printing why) if it can't be read
+bool ir_read_profile(const string& path, IrProfile&);
+
+// What --profile-use changed (--opt-report)
+struct ProfileStats {
+    unsigned cold_arms = 0;     // if arms moved out of line
+    unsigned hot_loops = 0;     // loops aligned
+    unsigned unrolled = 0;      //   & of those, unrolled
+    unsigned copies = 0;        //   (body copies added)
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  LOWERING                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// IrBuilder
+//
+// What the CNode lowering methods emit through. Keeps track of the block
+// being filled - a block is added to the layout when it's started.
+//
+class IrBuilder {
+public:
+    IrBuilder(IrFunction&, SymbolTable&);
+
+    int new_block();
+    void start_block(int);
+    int current_block() const { return block; }
+
+    int emit(IrOp, IrType, vector<int> args = {}, int64_t imm = 0);
+    void emit_void(IrOp, vector<int> args = {}, int64_t imm = 0);
+
+    // terminators (they end the current block)
+    void br(int target);
+    void cbr(int cond, int if_true, int if_false);
+    void ret();
+
+    int var(const string&);
+    IrType type_of(int vreg) const { return fn.vregs[vreg]; }
+
+    // while loop nesting
+    void enter_loop(int preheader, int header);
+    void exit_loop(int exit);
+
+    // source positions for what's emitted next (see IrInst::line)
+    void begin_statement(int line, int col);
+    void end_statement();
+    void begin_loop_body(int line);
+    void end_loop_body();
+
+    // --instrument: counters are only added once it's on (counter 0, the
+    // entry, is counted right away). add_counter gives -1 when it's off,
+    // & count / begin_counted do nothing with -1. The statements begun
+    // between begin_counted & end_counted are counted by that counter.
+    void instrument();
+    int add_counter(IrCounterKind, int line, int col);
+    void count(int counter);
+    void begin_counted(int counter);
+    void end_counted();
+
+    // --profile-use: lowering looks up what ran how often (& counts what
+    // it did about it)
+    void use_profile(const IrProfile&, ProfileStats&);
+
+    // whether an if arm (the if at line:col) is rarely run - moved out of
+    // line if it is (see IrColdArm)
+    void arm(bool else_arm, int line, int col, int entry, int after);
+
+    // how many copies of the innermost loop being lowered to make, with
+    // its first copy done (1: just the one)
+    int loop_copies();
+
+    static constexpr unsigned hot_loop_align = 32;
+
+private:
+    IrFunction& fn;
+    SymbolTable& symtbl;
+    int block = -1;
+    vector<int> open_loops;     // index into fn.loops
+
+    int line = 0, col = 0;
+    int region = -1;
+    vector<std::pair<int, int>> outer_positions;    // line:col of the statements
+    vector<int> outer_regions;                      // & loop bodies being lowered
+
+    const IrProfile* profile = nullptr;
+    ProfileStats* profile_stats = nullptr;
+
+    bool instrumenting = false;
+    int counter = -1;
+    vector<int> outer_counters;
+    map<string, int> var_index;
+
+    bool hot_loop(int line, int col) const;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   PASSES                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+// keep up to `max_vars` of each loop's variables in vregs while it runs
+void ir_promote_loop_vars(IrFunction&, unsigned max_vars);
+
+// move loop invariant computations into the loop preheaders (counts the
+// instructions moved)
+void ir_hoist_invariants(IrFunction&, unsigned& hoisted);
+
+// What dead code elimination removed (--opt-report)
+struct DceStats {
+    unsigned branches = 0;      // CBRs on a constant
+    unsigned blocks = 0;        // unreachable blocks
+    unsigned stores = 0;        // dead STOREVARs
+    unsigned zero_stores = 0;   //   (of which storing 0 - mostly declarations)
+    unsigned values = 0;        // unused computations
+};
+
+// constant branches, unreachable blocks, dead stores & unused values
+void ir_eliminate_dead_code(IrFunction&, DceStats&);
+
+// give every edge from a block with several successors into a block with
+// PHIs a block of its own (somewhere to put the PHI moves)
+void ir_split_critical_edges(IrFunction&);
+
+// move the cold if arms (fn.cold_arms) to the end of the layout
+void ir_layout_cold_arms(IrFunction&);
+
+// What strength reduction did (--opt-report). Powers are unrolled here in
+// the IR, multiplies & divisions by constants are picked by the backend.
+struct StrengthStats {
+    unsigned pow = 0;
+    unsigned mul = 0;
+    unsigned div = 0;
+    unsigned mod = 0;
+};
+
+// x ^ k with a small constant k becomes a chain of multiplies
+void ir_reduce_powers(IrFunction&, StrengthStats&);
+
+// a block's PHIs must come first, with an argument per pred - everything
+// from promotion on stops looking for them at the first other instruction
+// - & once the edges are split, no pred of a block with PHIs ends in a CBR
+// (exits with an error naming the pass `after` if one doesn't)
+void ir_check(const IrFunction&, const char* after, bool edges_split);
+
+// --dump-ir
+void ir_dump(const IrFunction&);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ir.h"
+
+using std::string, std::vector;
+
+// Symbols for the generated code
+//
+// The final code, cut up by where it came from (see SourceMark). perf
+// can't see into the JIT region on its own: a perf map names each range
+// of addresses, & a jitdump carries the code bytes & the source line of
+// each instruction range too (perf inject --jit turns it into an ELF image
+// per symbol).
+//
+struct SourceRange {
+    size_t start, end;      // offsets in the code
+    int line, col;          // 0: not from a statement (prologue, trampolines)
+    int region;             // fn.regions index, or -1
+};
+
+struct JitSymbol {
+    size_t start, end;      // offsets in the code
+    string name;
+};
+
+// one symbol per run of ranges in the same region - "<file>:<line>" for a
+// top level statement, "<file>:<line>:loop" for a while loop's body
+vector<JitSymbol> jit_symbols(const vector<SourceRange>&, const vector<IrRegion>&,
+                              size_t code_size, const string& file);
+
+// Line table: code offset -> source line:col, an entry wherever the
+// position changes (sorted by offset - each covers the code up to the
+// next). The code after the last statement (trampolines) has line 0.
+//
+struct LineEntry {
+    uint32_t offset;
+    int32_t line, col;
+};
+
+vector<LineEntry> line_table(const vector<SourceRange>&);
+
+// the entry covering code offset `at` (null before the first)
+const LineEntry* find_line(const vector<LineEntry>&, size_t at);
+
+// /tmp/perf-<pid>.map
+void write_perf_map(const uint8_t* code, const vector<JitSymbol>&);
+
+// jit-<pid>.dump in $JITDUMPDIR (or /tmp) - it stays mapped executable, for
+// perf record to notice
+void write_jitdump(const uint8_t* code, const vector<JitSymbol>&,
+                   const vector<SourceRange>&, const string& source_path);
@@ -0,0 +1,78 @@
+#pragma once
+
+// Command line options
+//
+//   ncc [options] /path/to/file
+//
+struct Options {
+    const char* filepath = nullptr;
+
+    // --align-loops=N : align while loop heads to N (16 or 32) bytes
+    unsigned loop_align = 0;
+
+    // --loop-regs=N : promote up to N (0-5) variables per loop out of memory
+    // (into SSA values the register allocator can keep in registers)
+    unsigned loop_regs = 5;
+
+    // --no-fold : skip constant folding & propagation over the code tree
+    bool fold = true;
+
+    // --no-strength : keep multiplies, powers & divisions by constants generic
+    bool strength_reduce = true;
+
+    // --no-licm : leave loop invariant computations inside their loops
+    bool licm = true;
+
+    // --no-dce : keep unreachable code, dead stores & unused values
+    bool dce = true;
+
+    // --no-peephole : skip the peephole pass over the generated code
+    bool peephole = true;
+
+    // --opt-report : print what the optimization passes did
+    bool opt_report = false;
+
+    // --dump-ir : print the IR (after the IR passes) before code generation
+    bool dump_ir = false;
+
+    // --async-output : write the program's output on a separate thread
+    bool async_output = false;
+
+    // --output=FILE : the program's output goes to FILE instead of stdout
+    const char* output_path = nullptr;
+
+    // --bench N : run the code N times (stdin replayed, output discarded)
+    // & report run times instead of the output
+    unsigned bench = 0;
+
+    // --counters[=json] : count cycles, instructions, cache misses ... over
+    // the program's run & each compile phase (summary, or one JSON line)
+    bool counters = false;
+    bool counters_json = false;
+
+    // --perf-map : name the generated code for perf (/tmp/perf-<pid>.map),
+    // one symbol per top level statement & per loop body
+    bool perf_map = false;
+
+    // --jitdump : the same symbols, with code bytes & line numbers, as a
+    // jitdump for perf inject --jit
+    bool jitdump = false;
+
+    // --profile[=HZ] : sample where the program is HZ (default 1000) times
+    // a second of CPU time & report the hot source lines
+    unsigned profile_hz = 0;
+
+    // --instrument[=FILE] : count each if arm & loop iteration as the code
+    // runs, & list the source with its counts after (also written to FILE,
+    // the source path + ".counts" by default)
+    bool instrument = false;
+    const char* counts_path = nullptr;
+
+    // --profile-use FILE : lay out & unroll the code by the counts FILE of an
+    // --instrument run (rare if arms out of line, hot loops aligned &
+    // unrolled)
+    const char* profile_use = nullptr;
+};
+
+// returns false (after printing usage) on bad arguments
+bool parse_options(int, char**, Options&);
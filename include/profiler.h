@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <signal.h>
+
+#include "jitsyms.h"
+
+using std::vector;
+
+// Sampling profiler
+//
+// SIGPROF every 1/hz seconds of CPU time (setitimer), & the handler looks
+// at where the program was. A pc inside the generated code counts for that
+// code offset. Anywhere else (a runtime helper, libc, the kernel's write),
+// the stack is searched for the return address of the call the generated
+// code made to get there, & the sample counts for the call instead - as
+// time spent in helpers on that line. The counts are per code offset until
+// report() maps them to lines.
+//
+class Profiler {
+public:
+    Profiler(const uint8_t* code, size_t code_size);
+    ~Profiler();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // start / stop sampling (only one profiler samples at a time) - samples
+    // add up over every start & stop
+    bool start(unsigned hz);
+    void stop();
+
+    // the hot lines, hottest first, with their source
+    void report(const vector<LineEntry>&) const;
+
+private:
+    static void on_sample(int, siginfo_t*, void*);
+
+    const uint8_t* code;
+    size_t code_size;
+    unsigned hz = 0;
+
+    vector<uint32_t> in_code;       // by code offset
+    vector<uint32_t> in_helpers;    // by the offset of the call
+    uint64_t elsewhere = 0;
+};
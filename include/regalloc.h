@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "assembler.h"
+#include "ir.h"
+
+using std::pair, std::vector;
+
+// Where a vreg's value lives for its whole lifetime
+//
+struct Location {
+    enum Kind : uint8_t {
+        NONE,       // never defined
+        REG,
+        SLOT,       // spilled: [rsp + 8*slot]
+        CONST,      // a CONST - rematerialized at every use
+        FLAGS       // a CMP only the CBR right after it uses - the flags hold it
+    };
+
+    Kind kind = NONE;
+    uint8_t reg = 0;
+    int slot = 0;
+    int64_t imm = 0;
+
+    bool operator==(const Location&) const = default;
+};
+
+// Linear scan register allocation over the IR
+//
+// Instructions are numbered in layout order (uses at 2i, defs at 2i+1) &
+// each vreg's lifetime is a list of ranges built from block liveness - a
+// loop variable isn't live between its last use in the body & the back
+// edge, so the hole can be shared. A PHI & its arguments are coalesced
+// into one lifetime when they don't intersect, which takes the moves out
+// of most loops entirely.
+//
+// Lifetimes are handed registers in order of their start (Poletto &
+// Sarkar), keeping the lifetimes still running on each register to check
+// new ones against (Traub et al. / Wimmer, for the holes). When nothing
+// is free, whichever of the clashing lifetimes ends last goes to a stack
+// slot.
+//
+// A CMP whose only use is the CBR right after it is never allocated
+// either - the backend branches on the flags it sets.
+//
+// rax, rdx & r11 are never allocated - they're scratch for the emitter
+// (division, spill reloads, PHI moves). Values live across a runtime call
+// only get callee saved registers (rbx, r12-r15).
+//
+class RegAllocator {
+public:
+    RegAllocator(const IrFunction&);
+
+    void run();
+
+    const Location& location(int vreg) const { return locs[vreg]; }
+    int slot_count() const { return slots; }
+
+    // callee saved registers handed out (they need saving in the prologue)
+    const vector<Reg64>& callee_saved_used() const { return callee_used; }
+
+private:
+    using Ranges = vector<pair<int, int>>;      // [from, to], sorted
+
+    const IrFunction& fn;
+
+    vector<Location> locs;
+    int slots = 0;
+    vector<Reg64> callee_used;
+
+    // numbering
+    vector<int> block_start, block_end;
+    vector<int> call_positions;
+
+    // liveness (sorted vreg lists per block)
+    vector<vector<int>> live_in, live_out;
+
+    // lifetimes - per vreg, then per coalesced group (indexed by its root)
+    vector<Ranges> ranges;
+    vector<int> group;
+    vector<vector<int>> hints;      // vregs whose register this one would like
+
+    // CONSTs & CMPs left in the flags never take part in allocation
+    bool unallocated(int vreg) const { return locs[vreg].kind == Location::CONST || locs[vreg].kind == Location::FLAGS; }
+    int find(int vreg);
+
+    void add_range(int vreg, int from, int to);
+    static bool intersect(const Ranges&, const Ranges&);
+    static Ranges merge(const Ranges&, const Ranges&);
+    bool crosses_call(const Ranges&) const;
+
+    void number();
+    void liveness();
+    void build_ranges();
+    void coalesce();
+    void allocate();
+};
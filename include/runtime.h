@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// A print statement's arguments, built at compile time in the data
+// segment: the PrintDesc, then `count` PrintArgs, then the text. Constant
+// arguments are already text there (adjacent ones merged into one piece),
+// the generated code stores the other values in before the call.
+//
+enum PrintTag : int32_t {
+    PRINT_TEXT,
+    PRINT_INT,
+    PRINT_BOOL,
+    PRINT_STR
+};
+
+struct PrintArg {
+    int32_t tag;
+    uint32_t len;       // PRINT_TEXT: length of the text
+    int64_t value;      // PRINT_TEXT: offset of the text from the PrintDesc,
+                        // otherwise the value (a char* for PRINT_STR)
+};
+
+struct PrintDesc {
+    uint32_t count;
+    uint32_t max_len;   // most bytes it can print (UINT32_MAX: no bound)
+};
+
+// Runtime helpers called from the generated code (System V calling
+// convention - the argument comes in rdi, a result goes back in eax)
+//
+void print_list(const PrintDesc*);
+int32_t read_int4();
+
+// read() takes its input from `text` instead of stdin (until the next call)
+void runtime_input(const char* text, size_t n);
+
+// Output
+//
+// Everything the program prints is formatted straight into a buffer. Full
+// buffers go out with write(2) - or, with async output, to a writer thread
+// that does the writing while the program carries on. Output is handed
+// off before each read (so a prompt shows first) & flushed when the program
+// is done. cout has to be flushed before the program runs, since it writes
+// around it.
+//
+
+// where the output goes: `path` (a mapped file) or stdout, async or not -
+// or nowhere (it's still formatted) with `discard`
+void runtime_output(bool async, const char* path, bool discard = false);
+
+// everything printed so far is out
+void runtime_flush();
+
+// flush, then stop the writer & close the output file
+void runtime_finish();
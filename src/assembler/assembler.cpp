@@ -0,0 +1,903 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "assembler.h"
+
+using std::cout;
+
+// longest x86-64 instruction - reserved up front so each instruction can be
+// written with the unchecked put* primitives
+constexpr size_t max_insn_len = 15;
+
+static bool fits_int8(int64_t val)
+{
+    return val >= INT8_MIN && val <= INT8_MAX;
+}
+
+static bool fits_int32(int64_t val)
+{
+    return val >= INT32_MIN && val <= INT32_MAX;
+}
+
+// spl, bpl, sil, dil are only addressable with a REX prefix
+static bool needs_byte_rex(uint8_t id)
+{
+    return id >= 4 && id < 8;
+}
+
+Assembler::Assembler(CodeBuffer& code)
+    : code{code}
+{}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  LABELS                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+Label Assembler::new_label()
+{
+    labels.push_back(-1);
+    return Label{static_cast<int>(labels.size() - 1)};
+}
+
+void Assembler::bind(Label label)
+{
+    labels[label.id] = code.offset();
+}
+
+int Assembler::mark()
+{
+    marks.push_back(code.offset());
+    return marks.size() - 1;
+}
+
+void Assembler::align(unsigned boundary)
+{
+    if (boundary <= 1) {
+        return;
+    }
+
+    // two requests at the same spot - keep the stricter one
+    if (!layout_items.empty()) {
+        auto& last = layout_items.back();
+        if (last.kind == LAYOUT_ALIGN && last.pos == code.offset()) {
+            last.align = std::max(last.align, boundary);
+            return;
+        }
+    }
+
+    layout_items.push_back(LayoutItem{code.offset(), 0, 0, LAYOUT_ALIGN, Cond::O, Label{}, boundary});
+}
+
+void Assembler::finalize()
+{
+    for (auto pos : labels) {
+        if (pos < 0) {
+            cout << "ERROR: Jump to unbound label in generated code\n";
+            std::exit(1);
+        }
+    }
+
+    if (peephole_enabled) {
+        peephole();
+    }
+    layout();
+
+    vector<size_t> trampolines;
+    emit_trampolines(trampolines);
+
+    for (auto& reloc : relocs) {
+        long end = reloc.pos + 4 + reloc.tail;
+        long target = reloc.call ? trampolines[reloc.target] : code.data_offset(reloc.target);
+        code.patch32(reloc.pos, target - end);
+    }
+
+    code.finalize();
+}
+
+int32_t Assembler::add_data(size_t n, size_t align, const void* init)
+{
+    return code.add_data(n, align, init);
+}
+
+// jmp [rip + 0] ; dq (helper) - the address sits right after the jump
+void Assembler::emit_trampolines(vector<size_t>& at)
+{
+    for (auto helper : helpers) {
+        while (code.offset() % 8 != 2) {
+            code.emit8(0xcc);
+        }
+        at.push_back(code.offset());
+        code.emit(array<uint8_t, 6>{0xff, 0x25, 0x00, 0x00, 0x00, 0x00});
+        code.emit64(helper);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  LAYOUT                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+// recommended multi-byte nops, indexed by length
+static const uint8_t nops[10][9] = {
+    {},
+    {0x90},
+    {0x66, 0x90},
+    {0x0f, 0x1f, 0x00},
+    {0x0f, 0x1f, 0x40, 0x00},
+    {0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00},
+    {0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00},
+    {0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    {0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+size_t Assembler::near_len(LayoutKind kind)
+{
+    return kind == LAYOUT_JMP ? 5 : 6;   // jmp rel32 / jcc rel32
+}
+
+size_t Assembler::map_offset(size_t pos) const
+{
+    // first item at or after pos
+    size_t lo = 0, hi = layout_items.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (layout_items[mid].pos < pos) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if (lo == layout_items.size()) {
+        return pos + layout_delta;
+    }
+
+    // padding for an alignment point goes in front of whatever is bound there
+    const auto& item = layout_items[lo];
+    long delta = item.delta_before;
+    if (item.pos == pos && item.kind == LAYOUT_ALIGN) {
+        delta += item.new_len;
+    }
+    return pos + delta;
+}
+
+// Final layout. Every branch starts out as rel8 & alignment padding is
+// computed from where things land. Any branch whose target is out of rel8
+// range gets widened to rel32 and the sizes are recomputed, until nothing
+// changes. Branches only ever grow, so this always terminates.
+void Assembler::layout()
+{
+    if (layout_items.empty()) {
+        return;
+    }
+
+    for (auto& item : layout_items) {
+        item.new_len = (item.kind == LAYOUT_ALIGN) ? 0 : 2;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        long delta = 0;
+        for (auto& item : layout_items) {
+            item.delta_before = delta;
+            if (item.kind == LAYOUT_ALIGN) {
+                size_t at = item.pos + delta;
+                item.new_len = (item.align - at % item.align) % item.align;
+            }
+            delta += static_cast<long>(item.new_len) - item.old_len;
+        }
+        layout_delta = delta;
+
+        for (auto& item : layout_items) {
+            if (item.kind == LAYOUT_ALIGN || item.new_len != 2) {
+                continue;
+            }
+
+            long at = item.pos + item.delta_before;
+            long disp = static_cast<long>(map_offset(labels[item.target.id])) - (at + 2);
+            if (!fits_int8(disp)) {
+                item.new_len = near_len(item.kind);
+                changed = true;
+            }
+        }
+    }
+
+    // rebuild the code with the final sizes
+    vector<uint8_t> old_code(code.data(), code.data() + code.offset());
+    code.truncate(0);
+
+    size_t copied = 0;
+    for (auto& item : layout_items) {
+        code.emit(&old_code[copied], item.pos - copied);
+        copied = item.pos + item.old_len;
+
+        if (item.kind == LAYOUT_ALIGN) {
+            for (size_t left = item.new_len; left > 0; ) {
+                size_t n = std::min<size_t>(left, 9);
+                code.emit(nops[n], n);
+                left -= n;
+            }
+        }
+        else {
+            long at = item.pos + item.delta_before;
+            long disp = static_cast<long>(map_offset(labels[item.target.id])) - (at + item.new_len);
+            put_branch(item.kind, item.cc, item.new_len == 2, disp);
+        }
+    }
+    code.emit(&old_code[copied], old_code.size() - copied);
+
+    for (auto& pos : labels) {
+        pos = map_offset(pos);
+    }
+    for (auto& reloc : relocs) {
+        reloc.pos = map_offset(reloc.pos);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                             ENCODING HELPERS                              //
+///////////////////////////////////////////////////////////////////////////////
+
+// REX prefix - only emitted when something actually needs it
+void Assembler::rex(bool w, uint8_t reg, uint8_t index, uint8_t rm, bool force)
+{
+    uint8_t byte = 0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (rm >> 3);
+    if (byte != 0x40 || force) {
+        code.put8(byte);
+    }
+}
+
+// register direct ModRM (mod = 11)
+void Assembler::modrm_reg(uint8_t reg, uint8_t rm)
+{
+    code.put8(0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// memory ModRM (+ SIB + displacement), using the shortest displacement
+void Assembler::modrm_mem(uint8_t reg, const Mem& mem)
+{
+    // [rip + disp32] - filled in at finalize, note() sets the tail
+    if (mem.rip) {
+        code.put8(((reg & 7) << 3) | 5);
+        relocs.push_back(Reloc{code.offset(), 0, false, mem.disp});
+        code.put32(0);
+        return;
+    }
+
+    uint8_t base = mem.base.id & 7;
+
+    uint8_t mod;
+    if (mem.disp == 0 && base != 5) {  // [rbp] / [r13] always need a displacement
+        mod = 0;
+    }
+    else if (fits_int8(mem.disp)) {
+        mod = 1;
+    }
+    else {
+        mod = 2;
+    }
+
+    if (mem.has_index || base == 4) {  // [rsp] / [r12] always need a SIB byte
+        uint8_t scale_bits = 0;
+        switch (mem.scale) {
+        case 1:    scale_bits = 0;    break;
+        case 2:    scale_bits = 1;    break;
+        case 4:    scale_bits = 2;    break;
+        case 8:    scale_bits = 3;    break;
+        }
+        uint8_t index = mem.has_index ? (mem.index.id & 7) : 4;
+
+        code.put8((mod << 6) | ((reg & 7) << 3) | 4);
+        code.put8((scale_bits << 6) | (index << 3) | base);
+    }
+    else {
+        code.put8((mod << 6) | ((reg & 7) << 3) | base);
+    }
+
+    if (mod == 1) {
+        code.put8(mem.disp);
+    }
+    else if (mod == 2) {
+        code.put32(mem.disp);
+    }
+}
+
+// op r/m, reg  (register direct)
+void Assembler::op_rr(bool w, uint8_t opcode, uint8_t reg, uint8_t rm)
+{
+    code.reserve(max_insn_len);
+    rex(w, reg, 0, rm);
+    code.put8(opcode);
+    modrm_reg(reg, rm);
+}
+
+// op reg, [mem]  /  op [mem], reg
+void Assembler::op_rm(bool w, uint8_t opcode, uint8_t reg, const Mem& mem)
+{
+    code.reserve(max_insn_len);
+    rex(w, reg, mem.has_index ? mem.index.id : 0, mem.base.id);
+    code.put8(opcode);
+    modrm_mem(reg, mem);
+}
+
+// group 1 ALU op with an immediate - picks imm8 / accumulator / imm32 forms
+void Assembler::alu_ri(bool w, uint8_t ext, uint8_t rm, int32_t imm)
+{
+    code.reserve(max_insn_len);
+    rex(w, 0, 0, rm);
+
+    if (fits_int8(imm)) {
+        code.put8(0x83);
+        modrm_reg(ext, rm);
+        code.put8(imm);
+    }
+    else if (rm == 0) {
+        code.put8((ext << 3) | 0x05);
+        code.put32(imm);
+    }
+    else {
+        code.put8(0x81);
+        modrm_reg(ext, rm);
+        code.put32(imm);
+    }
+}
+
+// group 2 shift by an immediate - shift by 1 has its own shorter form
+void Assembler::shift_ri(bool w, uint8_t ext, uint8_t rm, uint8_t imm)
+{
+    code.reserve(max_insn_len);
+    rex(w, 0, 0, rm);
+
+    if (imm == 1) {
+        code.put8(0xd1);
+        modrm_reg(ext, rm);
+    }
+    else {
+        code.put8(0xc1);
+        modrm_reg(ext, rm);
+        code.put8(imm);
+    }
+
+    // flags are left alone for a zero count, so they're used as well as defined
+    note({.uses = reg_bit(rm) | FLAGS_BIT, .defs = reg_bit(rm) | FLAGS_BIT});
+}
+
+// Jumps to bound (backward) labels use rel8 when it reaches, otherwise rel32.
+// Jumps to labels that aren't bound yet get a rel32 for now. Every branch is
+// recorded so the layout pass can fill in / shrink the displacement.
+void Assembler::branch(LayoutKind kind, Cond cc, Label target)
+{
+    code.reserve(max_insn_len);
+    size_t start = code.offset();
+    long target_pos = labels[target.id];
+
+    long short_disp = target_pos - static_cast<long>(start + 2);
+    if (target_pos >= 0 && fits_int8(short_disp)) {
+        put_branch(kind, cc, true, short_disp);
+    }
+    else if (target_pos >= 0) {
+        put_branch(kind, cc, false, target_pos - static_cast<long>(start + near_len(kind)));
+    }
+    else {
+        put_branch(kind, cc, false, 0);
+    }
+
+    uint8_t len = code.offset() - start;
+    layout_items.push_back(LayoutItem{start, len, len, kind, cc, target, 0});
+
+    if (kind == LAYOUT_JMP) {
+        note({.op = OP_JMP, .imm = target.id});
+    }
+    else {
+        note({.op = OP_JCC, .imm = target.id, .uses = FLAGS_BIT});
+    }
+}
+
+void Assembler::put_branch(LayoutKind kind, Cond cc, bool is_short, long disp)
+{
+    uint8_t cc_bits = static_cast<uint8_t>(cc);
+
+    code.reserve(max_insn_len);
+    if (is_short) {
+        code.put8(kind == LAYOUT_JMP ? 0xeb : 0x70 | cc_bits);
+        code.put8(disp);
+    }
+    else {
+        if (kind == LAYOUT_JMP) {
+            code.put8(0xe9);
+        }
+        else {
+            code.put8(0x0f);
+            code.put8(0x80 | cc_bits);
+        }
+        code.put32(disp);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                              DATA MOVEMENT                                //
+///////////////////////////////////////////////////////////////////////////////
+
+void Assembler::mov(Reg64 dst, Reg64 src)
+{
+    op_rr(true, 0x89, src.id, dst.id);
+    note({.op = OP_MOV_RR, .dst = dst.id, .src = src.id, .uses = reg_bit(src.id), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(Reg32 dst, Reg32 src)
+{
+    op_rr(false, 0x89, src.id, dst.id);
+    note({.op = OP_MOV_RR, .wide = false, .dst = dst.id, .src = src.id, .uses = reg_bit(src.id), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(Reg64 dst, int64_t imm)
+{
+    code.reserve(max_insn_len);
+
+    // mov r32, imm32 zero extends - shortest whenever the value allows
+    if (imm >= 0 && imm <= UINT32_MAX) {
+        rex(false, 0, 0, dst.id);
+        code.put8(0xb8 | (dst.id & 7));
+        code.put32(imm);
+    }
+    // mov r64, simm32
+    else if (fits_int32(imm)) {
+        rex(true, 0, 0, dst.id);
+        code.put8(0xc7);
+        modrm_reg(0, dst.id);
+        code.put32(imm);
+    }
+    // movabs r64, imm64
+    else {
+        rex(true, 0, 0, dst.id);
+        code.put8(0xb8 | (dst.id & 7));
+        code.put64(imm);
+    }
+
+    note({.op = OP_MOV_RI, .dst = dst.id, .imm = imm, .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(Reg32 dst, int32_t imm)
+{
+    code.reserve(max_insn_len);
+    rex(false, 0, 0, dst.id);
+    code.put8(0xb8 | (dst.id & 7));
+    code.put32(imm);
+    note({.op = OP_MOV_RI, .wide = false, .dst = dst.id, .imm = static_cast<uint32_t>(imm), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(Reg32 dst, const Mem& src)
+{
+    op_rm(false, 0x8b, dst.id, src);
+    note({.op = OP_LOAD, .wide = false, .dst = dst.id, .src = src.base.id, .imm = src.disp,
+          .indexed = src.has_index, .rip = src.rip, .uses = mem_uses(src), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(Reg64 dst, const Mem& src)
+{
+    op_rm(true, 0x8b, dst.id, src);
+    note({.op = OP_LOAD, .dst = dst.id, .src = src.base.id, .imm = src.disp,
+          .indexed = src.has_index, .rip = src.rip, .uses = mem_uses(src), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::mov(const Mem& dst, Reg32 src)
+{
+    op_rm(false, 0x89, src.id, dst);
+    note({.op = OP_STORE, .wide = false, .dst = dst.base.id, .src = src.id, .imm = dst.disp,
+          .indexed = dst.has_index, .rip = dst.rip, .uses = mem_uses(dst) | reg_bit(src.id)});
+}
+
+void Assembler::mov(const Mem& dst, Reg64 src)
+{
+    op_rm(true, 0x89, src.id, dst);
+    note({.op = OP_STORE, .dst = dst.base.id, .src = src.id, .imm = dst.disp,
+          .indexed = dst.has_index, .rip = dst.rip, .uses = mem_uses(dst) | reg_bit(src.id)});
+}
+
+void Assembler::mov(const Mem& dst, int32_t imm)
+{
+    op_rm(false, 0xc7, 0, dst);
+    code.put32(imm);
+    note({.uses = mem_uses(dst)});
+}
+
+void Assembler::movsx(Reg64 dst, Reg8 src)
+{
+    code.reserve(max_insn_len);
+    rex(true, dst.id, 0, src.id);
+    code.put8(0x0f);
+    code.put8(0xbe);
+    modrm_reg(dst.id, src.id);
+    note({.uses = reg_bit(src.id), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::movzx(Reg32 dst, Reg8 src)
+{
+    code.reserve(max_insn_len);
+    rex(false, dst.id, 0, src.id, needs_byte_rex(src.id));
+    code.put8(0x0f);
+    code.put8(0xb6);
+    modrm_reg(dst.id, src.id);
+    note({.op = OP_MOVZX, .wide = false, .dst = dst.id, .src = src.id, .uses = reg_bit(src.id), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::movsxd(Reg64 dst, Reg32 src)
+{
+    op_rr(true, 0x63, dst.id, src.id);
+    note({.uses = reg_bit(src.id), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::lea(Reg64 dst, const Mem& src)
+{
+    op_rm(true, 0x8d, dst.id, src);
+    note({.uses = mem_uses(src), .defs = reg_bit(dst.id)});
+}
+
+// 32-bit result of the 64-bit address (zero extended like any 32-bit op)
+void Assembler::lea(Reg32 dst, const Mem& src)
+{
+    op_rm(false, 0x8d, dst.id, src);
+    note({.wide = false, .uses = mem_uses(src), .defs = reg_bit(dst.id)});
+}
+
+void Assembler::push(Reg64 reg)
+{
+    code.reserve(max_insn_len);
+    rex(false, 0, 0, reg.id);
+    code.put8(0x50 | (reg.id & 7));
+    note({.op = OP_PUSH, .src = reg.id, .uses = reg_bit(reg.id) | reg_bit(rsp.id), .defs = reg_bit(rsp.id)});
+}
+
+void Assembler::pop(Reg64 reg)
+{
+    code.reserve(max_insn_len);
+    rex(false, 0, 0, reg.id);
+    code.put8(0x58 | (reg.id & 7));
+    note({.op = OP_POP, .dst = reg.id, .uses = reg_bit(rsp.id), .defs = reg_bit(reg.id) | reg_bit(rsp.id)});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                            ARITHMETIC / LOGIC                             //
+///////////////////////////////////////////////////////////////////////////////
+
+// opcode (op r/m, reg) & group 1 extension of each ALU op
+static const uint8_t alu_opcodes[] = {0x01, 0x29, 0x21, 0x09, 0x31};
+static const uint8_t alu_exts[]    = {0, 5, 4, 1, 6};
+
+// (alu) dst, src
+void Assembler::arith_rr(bool w, AluOp alu, uint8_t dst, uint8_t src)
+{
+    if (alu == ALU_IMUL) {
+        code.reserve(max_insn_len);
+        rex(w, dst, 0, src);
+        code.put8(0x0f);
+        code.put8(0xaf);
+        modrm_reg(dst, src);
+    }
+    else {
+        op_rr(w, alu_opcodes[alu], src, dst);
+    }
+    note({.op = OP_ALU_RR, .wide = w, .alu = alu, .dst = dst, .src = src,
+          .uses = reg_bit(dst) | reg_bit(src), .defs = reg_bit(dst) | FLAGS_BIT});
+}
+
+// (alu) dst, imm
+void Assembler::arith_ri(bool w, AluOp alu, uint8_t dst, int32_t imm)
+{
+    if (alu == ALU_IMUL) {
+        code.reserve(max_insn_len);
+        rex(w, dst, 0, dst);
+        if (fits_int8(imm)) {
+            code.put8(0x6b);
+            modrm_reg(dst, dst);
+            code.put8(imm);
+        }
+        else {
+            code.put8(0x69);
+            modrm_reg(dst, dst);
+            code.put32(imm);
+        }
+    }
+    else {
+        alu_ri(w, alu_exts[alu], dst, imm);
+    }
+    note({.op = OP_ALU_RI, .wide = w, .alu = alu, .dst = dst, .imm = imm,
+          .uses = reg_bit(dst), .defs = reg_bit(dst) | FLAGS_BIT});
+}
+
+void Assembler::add(Reg64 dst, Reg64 src)     {    arith_rr(true, ALU_ADD, dst.id, src.id);     }
+void Assembler::add(Reg64 dst, int32_t imm)   {    arith_ri(true, ALU_ADD, dst.id, imm);        }
+void Assembler::add(Reg32 dst, Reg32 src)     {    arith_rr(false, ALU_ADD, dst.id, src.id);    }
+void Assembler::add(Reg32 dst, int32_t imm)   {    arith_ri(false, ALU_ADD, dst.id, imm);       }
+void Assembler::sub(Reg64 dst, Reg64 src)     {    arith_rr(true, ALU_SUB, dst.id, src.id);     }
+void Assembler::sub(Reg64 dst, int32_t imm)   {    arith_ri(true, ALU_SUB, dst.id, imm);        }
+void Assembler::sub(Reg32 dst, Reg32 src)     {    arith_rr(false, ALU_SUB, dst.id, src.id);    }
+void Assembler::sub(Reg32 dst, int32_t imm)   {    arith_ri(false, ALU_SUB, dst.id, imm);       }
+void Assembler::and_(Reg64 dst, Reg64 src)    {    arith_rr(true, ALU_AND, dst.id, src.id);     }
+void Assembler::and_(Reg64 dst, int32_t imm)  {    arith_ri(true, ALU_AND, dst.id, imm);        }
+void Assembler::and_(Reg32 dst, Reg32 src)    {    arith_rr(false, ALU_AND, dst.id, src.id);    }
+void Assembler::and_(Reg32 dst, int32_t imm)  {    arith_ri(false, ALU_AND, dst.id, imm);       }
+void Assembler::or_(Reg64 dst, Reg64 src)     {    arith_rr(true, ALU_OR, dst.id, src.id);      }
+void Assembler::or_(Reg32 dst, Reg32 src)     {    arith_rr(false, ALU_OR, dst.id, src.id);     }
+void Assembler::xor_(Reg64 dst, Reg64 src)    {    arith_rr(true, ALU_XOR, dst.id, src.id);     }
+void Assembler::xor_(Reg32 dst, Reg32 src)    {    arith_rr(false, ALU_XOR, dst.id, src.id);    }
+void Assembler::imul(Reg64 dst, Reg64 src)    {    arith_rr(true, ALU_IMUL, dst.id, src.id);    }
+void Assembler::imul(Reg32 dst, Reg32 src)    {    arith_rr(false, ALU_IMUL, dst.id, src.id);   }
+
+void Assembler::cmp(Reg64 dst, Reg64 src)
+{
+    op_rr(true, 0x39, src.id, dst.id);
+    note({.op = OP_CMP_RR, .dst = dst.id, .src = src.id, .uses = reg_bit(dst.id) | reg_bit(src.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::cmp(Reg32 dst, Reg32 src)
+{
+    op_rr(false, 0x39, src.id, dst.id);
+    note({.op = OP_CMP_RR, .wide = false, .dst = dst.id, .src = src.id, .uses = reg_bit(dst.id) | reg_bit(src.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::cmp(Reg32 dst, int32_t imm)
+{
+    alu_ri(false, 7, dst.id, imm);
+    note({.op = OP_CMP_RI, .wide = false, .dst = dst.id, .imm = imm, .uses = reg_bit(dst.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::test(Reg64 dst, Reg64 src)
+{
+    op_rr(true, 0x85, src.id, dst.id);
+    note({.uses = reg_bit(dst.id) | reg_bit(src.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::test(Reg32 dst, Reg32 src)
+{
+    op_rr(false, 0x85, src.id, dst.id);
+    note({.uses = reg_bit(dst.id) | reg_bit(src.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::xor_(Reg8 dst, uint8_t imm)
+{
+    code.reserve(max_insn_len);
+    if (dst.id == 0) {
+        code.put8(0x34);
+    }
+    else {
+        rex(false, 0, 0, dst.id, needs_byte_rex(dst.id));
+        code.put8(0x80);
+        modrm_reg(6, dst.id);
+    }
+    code.put8(imm);
+    note({.uses = reg_bit(dst.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::test(Reg32 dst, int32_t imm)
+{
+    code.reserve(max_insn_len);
+    if (dst.id == 0) {
+        code.put8(0xa9);
+    }
+    else {
+        rex(false, 0, 0, dst.id);
+        code.put8(0xf7);
+        modrm_reg(0, dst.id);
+    }
+    code.put32(imm);
+    note({.uses = reg_bit(dst.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::test(Reg8 dst, uint8_t imm)
+{
+    code.reserve(max_insn_len);
+    if (dst.id == 0) {
+        code.put8(0xa8);
+    }
+    else {
+        rex(false, 0, 0, dst.id, needs_byte_rex(dst.id));
+        code.put8(0xf6);
+        modrm_reg(0, dst.id);
+    }
+    code.put8(imm);
+    note({.uses = reg_bit(dst.id), .defs = FLAGS_BIT});
+}
+
+void Assembler::imul(Reg64 dst, Reg64 src, int32_t imm)
+{
+    if (dst == src) {
+        arith_ri(true, ALU_IMUL, dst.id, imm);
+        return;
+    }
+
+    code.reserve(max_insn_len);
+    rex(true, dst.id, 0, src.id);
+    if (fits_int8(imm)) {
+        code.put8(0x6b);
+        modrm_reg(dst.id, src.id);
+        code.put8(imm);
+    }
+    else {
+        code.put8(0x69);
+        modrm_reg(dst.id, src.id);
+        code.put32(imm);
+    }
+    note({.uses = reg_bit(src.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::imul(Reg32 dst, Reg32 src, int32_t imm)
+{
+    if (dst == src) {
+        arith_ri(false, ALU_IMUL, dst.id, imm);
+        return;
+    }
+
+    code.reserve(max_insn_len);
+    rex(false, dst.id, 0, src.id);
+    if (fits_int8(imm)) {
+        code.put8(0x6b);
+        modrm_reg(dst.id, src.id);
+        code.put8(imm);
+    }
+    else {
+        code.put8(0x69);
+        modrm_reg(dst.id, src.id);
+        code.put32(imm);
+    }
+    note({.uses = reg_bit(src.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::idiv(Reg64 src)
+{
+    op_rr(true, 0xf7, 7, src.id);
+    note({.uses = reg_bit(src.id) | reg_bit(rax.id) | reg_bit(rdx.id),
+          .defs = reg_bit(rax.id) | reg_bit(rdx.id) | FLAGS_BIT});
+}
+
+void Assembler::idiv(Reg32 src)
+{
+    op_rr(false, 0xf7, 7, src.id);
+    note({.wide = false,
+          .uses = reg_bit(src.id) | reg_bit(rax.id) | reg_bit(rdx.id),
+          .defs = reg_bit(rax.id) | reg_bit(rdx.id) | FLAGS_BIT});
+}
+
+// sign extend eax into edx (ahead of a 32-bit idiv)
+void Assembler::cdq()
+{
+    code.reserve(max_insn_len);
+    code.put8(0x99);
+    note({.wide = false, .uses = reg_bit(rax.id), .defs = reg_bit(rdx.id)});
+}
+
+void Assembler::cqo()
+{
+    code.reserve(max_insn_len);
+    code.put8(0x48);
+    code.put8(0x99);
+    note({.uses = reg_bit(rax.id), .defs = reg_bit(rdx.id)});
+}
+
+void Assembler::neg(Reg64 dst)
+{
+    op_rr(true, 0xf7, 3, dst.id);
+    note({.uses = reg_bit(dst.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::neg(Reg32 dst)
+{
+    op_rr(false, 0xf7, 3, dst.id);
+    note({.wide = false, .uses = reg_bit(dst.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::inc(Reg32 dst)
+{
+    op_rr(false, 0xff, 0, dst.id);
+    note({.uses = reg_bit(dst.id), .defs = reg_bit(dst.id) | FLAGS_BIT});
+}
+
+void Assembler::inc(const Mem& dst)
+{
+    op_rm(true, 0xff, 0, dst);
+    note({.uses = mem_uses(dst), .defs = FLAGS_BIT});
+}
+
+void Assembler::shl(Reg64 dst, uint8_t imm)    {    shift_ri(true, 4, dst.id, imm);     }
+void Assembler::shr(Reg64 dst, uint8_t imm)    {    shift_ri(true, 5, dst.id, imm);     }
+void Assembler::sar(Reg64 dst, uint8_t imm)    {    shift_ri(true, 7, dst.id, imm);     }
+void Assembler::shl(Reg32 dst, uint8_t imm)    {    shift_ri(false, 4, dst.id, imm);    }
+void Assembler::shr(Reg32 dst, uint8_t imm)    {    shift_ri(false, 5, dst.id, imm);    }
+void Assembler::sar(Reg32 dst, uint8_t imm)    {    shift_ri(false, 7, dst.id, imm);    }
+
+void Assembler::setcc(Cond cc, Reg8 dst)
+{
+    code.reserve(max_insn_len);
+    rex(false, 0, 0, dst.id, needs_byte_rex(dst.id));
+    code.put8(0x0f);
+    code.put8(0x90 | static_cast<uint8_t>(cc));
+    modrm_reg(0, dst.id);
+
+    // only the low byte is written - the rest of the register passes through
+    note({.op = OP_SETCC, .dst = dst.id, .imm = static_cast<uint8_t>(cc),
+          .uses = reg_bit(dst.id) | FLAGS_BIT, .defs = reg_bit(dst.id)});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                               CONTROL FLOW                                //
+///////////////////////////////////////////////////////////////////////////////
+
+void Assembler::jmp(Label target)
+{
+    branch(LAYOUT_JMP, Cond::O, target);
+}
+
+void Assembler::jcc(Cond cc, Label target)
+{
+    branch(LAYOUT_JCC, cc, target);
+}
+
+// System V: arguments in rdi, rsi, rdx, rcx, r8, r9 - everything caller
+// saved is clobbered
+void Assembler::call(Reg64 target)
+{
+    op_rr(false, 0xff, 2, target.id);
+
+    uint32_t args = reg_bit(rdi.id) | reg_bit(rsi.id) | reg_bit(rdx.id) | reg_bit(rcx.id) | reg_bit(r8.id) | reg_bit(r9.id);
+    uint32_t clobbers = args | reg_bit(rax.id) | reg_bit(r10.id) | reg_bit(r11.id) | FLAGS_BIT;
+    note({.op = OP_CALL, .src = target.id, .uses = args | reg_bit(target.id) | reg_bit(rsp.id), .defs = clobbers});
+}
+
+void Assembler::call(const void* helper)
+{
+    auto target = reinterpret_cast<intptr_t>(helper);
+    size_t index = std::find(helpers.begin(), helpers.end(), target) - helpers.begin();
+    if (index == helpers.size()) {
+        helpers.push_back(target);
+    }
+
+    code.reserve(max_insn_len);
+    code.put8(0xe8);
+    relocs.push_back(Reloc{code.offset(), 0, true, static_cast<int32_t>(index)});
+    code.put32(0);
+
+    uint32_t args = reg_bit(rdi.id) | reg_bit(rsi.id) | reg_bit(rdx.id) | reg_bit(rcx.id) | reg_bit(r8.id) | reg_bit(r9.id);
+    uint32_t clobbers = args | reg_bit(rax.id) | reg_bit(r10.id) | reg_bit(r11.id) | FLAGS_BIT;
+    note({.op = OP_CALL, .uses = args | reg_bit(rsp.id), .defs = clobbers});
+}
+
+// the return value & everything callee saved is live out
+void Assembler::ret()
+{
+    code.reserve(max_insn_len);
+    code.put8(0xc3);
+
+    uint32_t callee_saved = reg_bit(rbx.id) | reg_bit(rsp.id) | reg_bit(rbp.id)
+                          | reg_bit(r12.id) | reg_bit(r13.id) | reg_bit(r14.id) | reg_bit(r15.id);
+    note({.op = OP_RET, .uses = callee_saved | reg_bit(rax.id)});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                           INSTRUCTION RECORDS                             //
+///////////////////////////////////////////////////////////////////////////////
+
+// Record the instruction just emitted. Instructions are contiguous, so it
+// starts where the previous one ended.
+void Assembler::note(Insn insn)
+{
+    insn.pos = insns.empty() ? 0 : insns.back().pos + insns.back().len;
+    insn.len = code.offset() - insn.pos;
+    insns.push_back(insn);
+
+    // an immediate after a [rip + disp32] is between it & where rip points
+    if (!relocs.empty() && relocs.back().pos > insn.pos) {
+        relocs.back().tail = insn.pos + insn.len - (relocs.back().pos + 4);
+    }
+}
+
+uint32_t Assembler::mem_uses(const Mem& mem) const
+{
+    if (mem.rip) {
+        return 0;
+    }
+    return reg_bit(mem.base.id) | (mem.has_index ? reg_bit(mem.index.id) : 0);
+}
@@ -0,0 +1,356 @@
+#include <algorithm>
+
+#include "assembler.h"
+
+// Peephole pass
+//
+// Runs over the instruction records before layout. Each pattern looks at a
+// fixed size window of straight line instructions (no branches or calls in
+// it, & nothing jumps into the middle of it) and either passes or emits a
+// replacement for the whole window. Patterns that drop a register write
+// check it against a liveness pass over the records, so they hold up
+// across branches & loop back edges.
+//
+// Replacements are encoded with the assembler itself (at the end of the
+// buffer, then cut back out), & the code is rebuilt once at the end with
+// every label, layout item & relocation shifted to match.
+
+namespace {
+
+struct Window {
+    const Insn* insn;           // the window's instructions
+    const uint32_t* live_out;   // registers (& flags) live after each one
+};
+
+struct Pattern {
+    const char* name;
+    int length;
+    bool (*match)(const Window&);
+    void (*emit)(Assembler&, const Window&);
+};
+
+bool is_dead(const Window& w, int i, uint32_t mask)
+{
+    return (w.live_out[i] & mask) == 0;
+}
+
+// 32-bit (alu) dst, src / dst, imm - false if there's no such form
+bool has_alu32_ri(AluOp alu)
+{
+    return alu == ALU_ADD || alu == ALU_SUB || alu == ALU_AND || alu == ALU_IMUL;
+}
+
+void emit_alu32(Assembler& as, const Insn& op, Reg32 dst)
+{
+    if (op.op == OP_ALU_RR) {
+        Reg32 src{op.src};
+        switch (op.alu) {
+        case ALU_ADD:     as.add(dst, src);     break;
+        case ALU_SUB:     as.sub(dst, src);     break;
+        case ALU_AND:     as.and_(dst, src);    break;
+        case ALU_OR:      as.or_(dst, src);     break;
+        case ALU_XOR:     as.xor_(dst, src);    break;
+        case ALU_IMUL:    as.imul(dst, src);    break;
+        }
+        return;
+    }
+
+    int32_t imm = op.imm;
+    switch (op.alu) {
+    case ALU_ADD:     as.add(dst, imm);         break;
+    case ALU_SUB:     as.sub(dst, imm);         break;
+    case ALU_AND:     as.and_(dst, imm);        break;
+    case ALU_IMUL:    as.imul(dst, dst, imm);   break;
+    default:                                    break;
+    }
+}
+
+// ============================== //
+//            Patterns            //
+// ============================== //
+
+// mov [x], r ; mov s, [x]   ->   mov [x], r ; mov s, r
+// (x a data segment entry - a variable stored & loaded straight back)
+bool match_store_reload(const Window& w)
+{
+    auto& store = w.insn[0];
+    auto& load = w.insn[1];
+
+    return store.op == OP_STORE && load.op == OP_LOAD && store.rip && load.rip
+        && store.imm == load.imm && store.wide == load.wide;
+}
+
+void emit_store_reload(Assembler& as, const Window& w)
+{
+    auto& store = w.insn[0];
+    auto& load = w.insn[1];
+    Mem var = Mem::data(store.imm);
+
+    if (store.wide) {
+        as.mov(var, Reg64{store.src});
+        if (load.dst != store.src) {
+            as.mov(Reg64{load.dst}, Reg64{store.src});
+        }
+    }
+    else {
+        as.mov(var, Reg32{store.src});
+        if (load.dst != store.src) {
+            as.mov(Reg32{load.dst}, Reg32{store.src});
+        }
+    }
+}
+
+// mov t, h ; (alu) t, x ; mov h, t   ->   (alu) h, x
+// (32-bit moves, t & the flags dead after)
+bool match_copy_op_back(const Window& w)
+{
+    auto& copy = w.insn[0];
+    auto& op = w.insn[1];
+    auto& back = w.insn[2];
+
+    uint8_t t = copy.dst;
+    uint8_t h = copy.src;
+
+    if (copy.op != OP_MOV_RR || copy.wide || back.op != OP_MOV_RR || back.wide) {
+        return false;
+    }
+    if (t == h || back.dst != h || back.src != t || op.dst != t) {
+        return false;
+    }
+    if (op.op == OP_ALU_RR) {
+        if (op.src == t) {
+            return false;
+        }
+    }
+    else if (op.op != OP_ALU_RI || !has_alu32_ri(op.alu)) {
+        return false;
+    }
+
+    return is_dead(w, 2, reg_bit(t) | FLAGS_BIT);
+}
+
+void emit_copy_op_back(Assembler& as, const Window& w)
+{
+    emit_alu32(as, w.insn[1], Reg32{w.insn[0].src});
+}
+
+// mov t, (anything)   ->   (nothing), when t is dead after
+bool match_dead_move(const Window& w)
+{
+    auto& mov = w.insn[0];
+    return (mov.op == OP_MOV_RR || mov.op == OP_MOV_RI) && is_dead(w, 0, reg_bit(mov.dst));
+}
+
+void emit_nothing(Assembler& as, const Window& w)
+{
+}
+
+// Tried in order at each instruction - the first match wins
+const Pattern patterns[] = {
+    {"store-reload",      2,  match_store_reload,        emit_store_reload},
+    {"copy-op-back",      3,  match_copy_op_back,        emit_copy_op_back},
+    {"dead-move",         1,  match_dead_move,           emit_nothing},
+};
+
+bool is_control(const Insn& insn)
+{
+    return insn.op == OP_JMP || insn.op == OP_JCC || insn.op == OP_CALL || insn.op == OP_RET;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 PEEPHOLE                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+void Assembler::peephole()
+{
+    size_t n = insns.size();
+
+    peephole_stats.clear();
+    for (auto& pattern : patterns) {
+        peephole_stats.push_back(PeepholeStat{pattern.name});
+    }
+
+    // instruction a position lands on (n past the end)
+    auto insn_at = [&](size_t pos) {
+        return std::lower_bound(insns.begin(), insns.end(), pos, [](const Insn& insn, size_t p) {
+            return insn.pos < p;
+        }) - insns.begin();
+    };
+
+    // liveness - iterated backwards to a fixed point (loops)
+    vector<uint32_t> live_in(n + 1, 0), live_out(n, 0);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (size_t i = n; i-- > 0; ) {
+            auto& insn = insns[i];
+
+            uint32_t out = 0;
+            if (insn.op != OP_JMP && insn.op != OP_RET) {
+                out |= live_in[i + 1];
+            }
+            if (insn.op == OP_JMP || insn.op == OP_JCC) {
+                out |= live_in[insn_at(labels[insn.imm])];
+            }
+
+            uint32_t in = insn.uses | (out & ~insn.defs);
+            if (out != live_out[i] || in != live_in[i]) {
+                live_out[i] = out;
+                live_in[i] = in;
+                changed = true;
+            }
+        }
+    }
+
+    // places control can arrive at other than by falling through
+    vector<size_t> entries;
+    for (auto pos : labels) {
+        entries.push_back(pos);
+    }
+    for (auto& item : layout_items) {
+        if (item.kind == LAYOUT_ALIGN) {
+            entries.push_back(item.pos);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    auto straight_line = [&](size_t first, size_t len) {
+        for (size_t i = first; i < first + len; i++) {
+            if (is_control(insns[i])) {
+                return false;
+            }
+        }
+        auto it = std::upper_bound(entries.begin(), entries.end(), insns[first].pos);
+        return it == entries.end() || *it > insns[first + len - 1].pos;
+    };
+
+    struct Edit {
+        size_t pos, old_len;
+        vector<uint8_t> bytes;
+        vector<Reloc> relocs;   // in the replacement (pos from its start)
+    };
+    vector<Edit> edits;
+
+    for (size_t i = 0; i < n; i++) {
+        for (size_t p = 0; p < std::size(patterns); p++) {
+            auto& pattern = patterns[p];
+            size_t len = pattern.length;
+
+            if (i + len > n || !straight_line(i, len)) {
+                continue;
+            }
+
+            Window window{&insns[i], &live_out[i]};
+            if (!pattern.match(window)) {
+                continue;
+            }
+
+            // encode the replacement past the end of the code, then take it back out
+            size_t at = code.offset();
+            size_t records = insns.size();
+            size_t reloc_count = relocs.size();
+            pattern.emit(*this, window);
+
+            Edit edit{insns[i].pos, insns[i + len - 1].pos + insns[i + len - 1].len - insns[i].pos};
+            edit.bytes.assign(code.data() + at, code.data() + code.offset());
+            for (size_t r = reloc_count; r < relocs.size(); r++) {
+                edit.relocs.push_back(relocs[r]);
+                edit.relocs.back().pos -= at;
+            }
+
+            auto& stat = peephole_stats[p];
+            stat.hits++;
+            stat.insns_removed += len - (insns.size() - records);
+            stat.bytes_removed += edit.old_len - edit.bytes.size();
+
+            code.truncate(at);
+            insns.resize(records);
+            relocs.resize(reloc_count);
+            edits.push_back(std::move(edit));
+
+            i += len - 1;
+            break;
+        }
+    }
+
+    if (edits.empty()) {
+        return;
+    }
+
+    // total size change of the edits before pos - nothing is bound inside a
+    // window, so a position at the start of one stays put
+    vector<long> delta_after(edits.size());
+    long delta = 0;
+    for (size_t e = 0; e < edits.size(); e++) {
+        delta += static_cast<long>(edits[e].bytes.size()) - static_cast<long>(edits[e].old_len);
+        delta_after[e] = delta;
+    }
+
+    auto shift = [&](size_t pos) {
+        auto it = std::lower_bound(edits.begin(), edits.end(), pos, [](const Edit& edit, size_t p) {
+            return edit.pos < p;
+        });
+        size_t before = it - edits.begin();
+        return before == 0 ? pos : pos + delta_after[before - 1];
+    };
+
+    vector<uint8_t> old_code(code.data(), code.data() + code.offset());
+    code.truncate(0);
+
+    size_t copied = 0;
+    for (auto& edit : edits) {
+        code.emit(&old_code[copied], edit.pos - copied);
+        code.emit(edit.bytes.data(), edit.bytes.size());
+        copied = edit.pos + edit.old_len;
+    }
+    code.emit(&old_code[copied], old_code.size() - copied);
+
+    // the edit whose window covers pos, or null
+    auto inside = [&](size_t pos) -> const Edit* {
+        auto it = std::upper_bound(edits.begin(), edits.end(), pos, [](size_t p, const Edit& edit) {
+            return p < edit.pos;
+        });
+        if (it == edits.begin() || pos >= (it - 1)->pos + (it - 1)->old_len) {
+            return nullptr;
+        }
+        return &*(it - 1);
+    };
+
+    for (auto& pos : labels) {
+        pos = shift(pos);
+    }
+    for (auto& item : layout_items) {
+        item.pos = shift(item.pos);
+    }
+
+    // (marks can be inside a window - they go to its start)
+    for (auto& pos : marks) {
+        if (auto edit = inside(pos)) {
+            pos = edit->pos;
+        }
+        pos = shift(pos);
+    }
+
+    // the ones in replaced windows go, the replacements' come in
+    vector<Reloc> kept;
+    for (auto& reloc : relocs) {
+        if (!inside(reloc.pos)) {
+            kept.push_back(reloc);
+            kept.back().pos = shift(reloc.pos);
+        }
+    }
+    for (auto& edit : edits) {
+        size_t start = shift(edit.pos);
+        for (auto reloc : edit.relocs) {
+            reloc.pos += start;
+            kept.push_back(reloc);
+        }
+    }
+    relocs = std::move(kept);
+
+    // the records no longer line up with the code
+    insns.clear();
+}
@@ -0,0 +1,966 @@
+#include <iostream>
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "backend.h"
+#include "runtime.h"
+
+using std::cout;
+
+Backend::Backend(const IrFunction& fn, Assembler& as, StrengthStats* reduce)
+    : fn{fn}
+    , as{as}
+    , regs{fn}
+    , reduce{reduce}
+{}
+
+void Backend::emit()
+{
+    regs.run();
+
+    // every variable gets an int4 of the data segment
+    for (size_t v = 0; v < fn.vars.size(); v++) {
+        var_data.push_back(as.add_data(4, 4));
+    }
+
+    // & every execution counter a qword (--instrument)
+    if (!fn.counters.empty()) {
+        counter_data = as.add_data(8 * fn.counters.size(), 8);
+    }
+
+    // (only blocks still in the layout - the assembler wants every label bound)
+    labels.assign(fn.blocks.size(), Label{});
+    for (int b : fn.layout) {
+        labels[b] = as.new_label();
+    }
+
+    marks.push_back(SourceMark{as.mark(), 0, 0, -1});
+    prologue();
+
+    for (size_t i = 0; i < fn.layout.size(); i++) {
+        int b = fn.layout[i];
+        next_block = (i + 1 < fn.layout.size()) ? fn.layout[i + 1] : -1;
+
+        for (auto& loop : fn.loops) {
+            if (loop.header == b) {
+                if (loop.align > 0) {
+                    as.align(loop.align);
+                }
+                else {
+                    as.align_loop();
+                }
+                break;
+            }
+        }
+        as.bind(labels[b]);
+
+        for (auto& inst : fn.blocks[b].insts) {
+            auto& last = marks.back();
+            if (inst.line != 0 && (inst.line != last.line || inst.col != last.col || inst.region != last.region)) {
+                marks.push_back(SourceMark{as.mark(), inst.line, inst.col, inst.region});
+            }
+            emit_inst(b, inst);
+        }
+    }
+
+    marks.push_back(SourceMark{as.mark(), -1, 0, -1});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  OPERANDS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// the value of a vreg into a register (nothing if it's there already)
+void Backend::load(Reg32 reg, int vreg)
+{
+    auto& l = loc(vreg);
+    switch (l.kind) {
+    case Location::REG:
+        if (l.reg != reg.id) {
+            as.mov(reg, Reg32{l.reg});
+        }
+        break;
+    case Location::SLOT:
+        as.mov(reg, slot(l));
+        break;
+    case Location::CONST:
+        as.mov(reg, static_cast<int32_t>(l.imm));
+        break;
+    case Location::NONE:
+    case Location::FLAGS:
+        cout << "ERROR: Use of undefined value v" << vreg << " in code generation\n";
+        std::exit(1);
+    }
+}
+
+void Backend::load64(Reg64 reg, int vreg)
+{
+    auto& l = loc(vreg);
+    switch (l.kind) {
+    case Location::REG:
+        if (l.reg != reg.id) {
+            as.mov(reg, Reg64{l.reg});
+        }
+        break;
+    case Location::SLOT:
+        as.mov(reg, slot(l));
+        break;
+    case Location::CONST:
+        as.mov(reg, l.imm);
+        break;
+    case Location::NONE:
+    case Location::FLAGS:
+        cout << "ERROR: Use of undefined value v" << vreg << " in code generation\n";
+        std::exit(1);
+    }
+}
+
+// a register holding the vreg - its own, or `scratch` loaded with it
+Reg32 Backend::use(int vreg, Reg32 scratch)
+{
+    if (loc(vreg).kind == Location::REG) {
+        return Reg32{loc(vreg).reg};
+    }
+    load(scratch, vreg);
+    return scratch;
+}
+
+// the register to compute a vreg in - its own, or `scratch` when spilled
+Reg32 Backend::def(int vreg, Reg32 scratch)
+{
+    if (loc(vreg).kind == Location::REG) {
+        return Reg32{loc(vreg).reg};
+    }
+    return scratch;
+}
+
+// write a spilled vreg back to its slot once computed
+void Backend::commit(int vreg, Reg32 reg)
+{
+    if (loc(vreg).kind == Location::SLOT) {
+        as.mov(slot(loc(vreg)), reg);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                PHI MOVES                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+void Backend::move(const Location& dst, const Location& src, bool wide)
+{
+    if (dst == src) {
+        return;
+    }
+
+    if (dst.kind == Location::REG) {
+        Reg64 reg{dst.reg};
+        switch (src.kind) {
+        case Location::REG:
+            wide ? as.mov(reg, Reg64{src.reg}) : as.mov(reg.r32(), Reg32{src.reg});
+            break;
+        case Location::SLOT:
+            wide ? as.mov(reg, slot(src)) : as.mov(reg.r32(), slot(src));
+            break;
+        case Location::CONST:
+            wide ? as.mov(reg, src.imm) : as.mov(reg.r32(), static_cast<int32_t>(src.imm));
+            break;
+        case Location::NONE:
+        case Location::FLAGS:
+            break;
+        }
+    }
+    else if (dst.kind == Location::SLOT) {
+        switch (src.kind) {
+        case Location::REG:
+            wide ? as.mov(slot(dst), Reg64{src.reg}) : as.mov(slot(dst), Reg32{src.reg});
+            break;
+        case Location::SLOT:
+            move(Location{.kind = Location::REG, .reg = rax.id}, src, wide);
+            wide ? as.mov(slot(dst), rax) : as.mov(slot(dst), eax);
+            break;
+        case Location::CONST:
+            if (wide) {
+                as.mov(rax, src.imm);
+                as.mov(slot(dst), rax);
+            }
+            else {
+                as.mov(slot(dst), static_cast<int32_t>(src.imm));
+            }
+            break;
+        case Location::NONE:
+        case Location::FLAGS:
+            break;
+        }
+    }
+}
+
+// The PHIs of `to` take their values from `from` all at once, so the
+// moves are ordered to never overwrite a source still to be read. A cycle
+// (values swapping places) is broken by parking one value in r11.
+void Backend::phi_moves(int from, int to)
+{
+    auto& target = fn.blocks[to];
+
+    size_t index = 0;
+    while (index < target.preds.size() && target.preds[index] != from) {
+        index++;
+    }
+
+    struct Move {
+        Location dst, src;
+        bool wide;
+    };
+    vector<Move> moves;
+
+    for (auto& inst : target.insts) {
+        if (inst.op != IrOp::PHI) {
+            break;
+        }
+        auto& dst = loc(inst.dst);
+        auto& src = loc(inst.args[index]);
+        if (dst != src) {
+            moves.push_back({dst, src, fn.vregs[inst.dst] == IrType::STR});
+        }
+    }
+
+    while (!moves.empty()) {
+        bool progress = false;
+
+        for (size_t i = 0; i < moves.size(); i++) {
+            bool blocked = false;
+            for (size_t j = 0; j < moves.size(); j++) {
+                if (j != i && moves[j].src == moves[i].dst) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (!blocked) {
+                move(moves[i].dst, moves[i].src, moves[i].wide);
+                moves.erase(moves.begin() + i);
+                progress = true;
+                break;
+            }
+        }
+
+        if (!progress) {
+            Location parked{.kind = Location::REG, .reg = r11.id};
+            Location freed = moves[0].dst;
+            move(parked, freed, true);
+            for (auto& m : moves) {
+                if (m.src == freed) {
+                    m.src = parked;
+                }
+            }
+        }
+    }
+}
+
+void Backend::jump_to(int from, int to)
+{
+    phi_moves(from, to);
+    if (to != next_block) {
+        as.jmp(labels[to]);             // jmp (to)
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                             PROLOGUE / EPILOGUE                           //
+///////////////////////////////////////////////////////////////////////////////
+
+// callee saved registers in use are pushed, then the spill slots go below
+// them - keeping rsp 16-byte aligned at the runtime helper calls
+void Backend::prologue()
+{
+    for (auto reg : regs.callee_saved_used()) {
+        as.push(reg);                   // push (reg)
+    }
+
+    frame = 8 * regs.slot_count();
+    int pushed = 8 + 8 * regs.callee_saved_used().size();
+    if ((pushed + frame) % 16 != 0) {
+        frame += 8;
+    }
+
+    if (frame > 0) {
+        as.sub(rsp, frame);             // sub rsp, (frame)
+    }
+}
+
+void Backend::epilogue()
+{
+    if (frame > 0) {
+        as.add(rsp, frame);             // add rsp, (frame)
+    }
+
+    auto& saved = regs.callee_saved_used();
+    for (auto it = saved.rbegin(); it != saved.rend(); it++) {
+        as.pop(*it);                    // pop (reg)
+    }
+    as.ret();                           // ret
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                               INSTRUCTIONS                                //
+///////////////////////////////////////////////////////////////////////////////
+
+void Backend::emit_inst(int block, const IrInst& inst)
+{
+    auto& succs = fn.blocks[block].succs;
+
+    switch (inst.op) {
+    // CONSTs are used where they're needed, PHIs happen in the preds
+    case IrOp::CONST:
+    case IrOp::PHI:
+        break;
+
+    case IrOp::LOADVAR: {
+        Reg32 dst = def(inst.dst, eax);
+        as.mov(dst, var(inst.imm));                 // mov (dst), [rip + (var)]
+        commit(inst.dst, dst);
+        break;
+    }
+
+    case IrOp::STOREVAR: {
+        int val = inst.args[0];
+        if (is_const(val)) {
+            as.mov(var(inst.imm), const_value(val));    // mov dword [rip + (var)], (val)
+        }
+        else {
+            as.mov(var(inst.imm), use(val, edx));       // mov [rip + (var)], (val)
+        }
+        break;
+    }
+
+    case IrOp::ADD:
+    case IrOp::SUB:
+    case IrOp::MUL:
+        emit_arith(inst);
+        break;
+
+    case IrOp::DIV:
+    case IrOp::MOD:
+        emit_div(inst);
+        break;
+
+    case IrOp::POW:
+        emit_pow(inst);
+        break;
+
+    case IrOp::NEG: {
+        Reg32 dst = def(inst.dst, eax);
+        load(dst, inst.args[0]);
+        as.neg(dst);                                // neg (dst)
+        commit(inst.dst, dst);
+        break;
+    }
+
+    case IrOp::NOT: {
+        Reg32 dst = def(inst.dst, eax);
+        load(dst, inst.args[0]);
+        as.xor_(Reg8{dst.id}, 1);                   // xor (dst8), 1
+        commit(inst.dst, dst);
+        break;
+    }
+
+    case IrOp::CMP:
+        emit_cmp(inst);
+        break;
+
+    case IrOp::COPY: {
+        Reg32 dst = def(inst.dst, eax);
+        load(dst, inst.args[0]);
+        commit(inst.dst, dst);
+        break;
+    }
+
+    case IrOp::PRINT:
+        emit_print(inst);
+        break;
+
+    case IrOp::READ:
+        emit_call(reinterpret_cast<intptr_t>(read_int4));
+        if (loc(inst.dst).kind == Location::REG) {
+            as.mov(Reg32{loc(inst.dst).reg}, eax);  // mov (dst), eax
+        }
+        commit(inst.dst, eax);
+        break;
+
+    case IrOp::BR:
+        jump_to(block, succs[0]);
+        break;
+
+    case IrOp::CBR: {
+        int cond = inst.args[0];
+        if (is_const(cond)) {
+            jump_to(block, const_value(cond) ? succs[0] : succs[1]);
+            break;
+        }
+
+        // (a CMP just before sets the flags itself)
+        Cond cc = flags;
+        if (loc(cond).kind != Location::FLAGS) {
+            Reg32 reg = use(cond, eax);
+            as.test(Reg8{reg.id}, 1);               // test (cond8), 1
+            cc = Cond::NE;
+        }
+
+        if (succs[0] == next_block) {
+            as.jcc(invert(cc), labels[succs[1]]);   // j(!cc) (false)
+        }
+        else {
+            as.jcc(cc, labels[succs[0]]);           // j(cc) (true)
+            if (succs[1] != next_block) {
+                as.jmp(labels[succs[1]]);           // jmp (false)
+            }
+        }
+        break;
+    }
+
+    case IrOp::RET:
+        epilogue();
+        break;
+
+    case IrOp::COUNT:
+        as.inc(Mem::data(counter_data + 8 * inst.imm));     // inc qword [rip + (counter)]
+        break;
+    }
+}
+
+// dst = a (op) b, two address: the result register gets a, then b is
+// applied to it (as an immediate when it's a CONST)
+void Backend::emit_arith(const IrInst& inst)
+{
+    int a = inst.args[0];
+    int b = inst.args[1];
+    bool commutes = inst.op != IrOp::SUB;
+
+    if (commutes && is_const(a) && !is_const(b)) {
+        std::swap(a, b);
+    }
+
+    Reg32 dst = def(inst.dst, eax);
+
+    auto apply = [&](Reg32 reg) {
+        switch (inst.op) {
+        case IrOp::ADD:     as.add(dst, reg);     break;
+        case IrOp::SUB:     as.sub(dst, reg);     break;
+        default:            as.imul(dst, reg);    break;
+        }
+    };
+
+    if (is_const(b)) {
+        int32_t imm = const_value(b);
+        switch (inst.op) {
+        case IrOp::ADD:
+            load(dst, a);
+            as.add(dst, imm);                       // add (dst), (imm)
+            break;
+        case IrOp::SUB:
+            load(dst, a);
+            as.sub(dst, imm);                       // sub (dst), (imm)
+            break;
+        default: {
+            Reg32 src = use(a, eax);
+            if (reduce && mul_by_const(dst, src, imm)) {
+                reduce->mul++;
+            }
+            else {
+                as.imul(dst, src, imm);             // imul (dst), (a), (imm)
+            }
+            break;
+        }
+        }
+    }
+    else {
+        Reg32 right = use(b, edx);
+        bool a_in_dst = loc(a).kind == Location::REG && loc(a).reg == dst.id;
+
+        // b already sits where the result goes
+        if (right == dst && !a_in_dst) {
+            if (commutes) {
+                apply(use(a, eax));
+            }
+            else {
+                as.mov(edx, right);                 // mov edx, (b)
+                load(dst, a);
+                apply(edx);
+            }
+        }
+        else {
+            load(dst, a);
+            apply(right);
+        }
+    }
+
+    commit(inst.dst, dst);
+}
+
+// signed division with C semantics (truncating) - eax / edx hold the
+// dividend, the quotient comes back in eax & the remainder in edx
+void Backend::emit_div(const IrInst& inst)
+{
+    if (reduce && (div_by_pow2(inst) || div_by_magic(inst))) {
+        (inst.op == IrOp::DIV) ? reduce->div++ : reduce->mod++;
+        return;
+    }
+
+    load(eax, inst.args[0]);
+    as.cdq();                                       // cdq
+
+    Reg32 divisor = use(inst.args[1], r11d);
+    as.idiv(divisor);                               // idiv (divisor)
+
+    Reg32 result = (inst.op == IrOp::DIV) ? eax : edx;
+    if (loc(inst.dst).kind == Location::REG) {
+        as.mov(Reg32{loc(inst.dst).reg}, result);   // mov (dst), (result)
+    }
+    commit(inst.dst, result);
+}
+
+static bool is_pow2(uint32_t val)
+{
+    return val != 0 && (val & (val - 1)) == 0;
+}
+
+// dst = src * imm as (2^s) * (1, 3, 5, 9 or 2^k +- 1), negated for a
+// negative imm - only when that's at most two real steps (the copy into
+// dst is nearly free), otherwise imul's 3 cycles win
+bool Backend::mul_by_const(Reg32 dst, Reg32 src, int32_t imm)
+{
+    if (imm == 0) {
+        as.xor_(dst, dst);                          // xor (dst), (dst)
+        return true;
+    }
+    if (imm == INT32_MIN) {
+        return false;
+    }
+
+    bool negate = imm < 0;
+    uint32_t val = negate ? -imm : imm;
+    int shift = __builtin_ctz(val);
+    uint32_t odd = val >> shift;
+
+    int steps = (shift > 0) + negate;
+    if (odd == 3 || odd == 5 || odd == 9) {
+        steps += 1;
+    }
+    else if (odd != 1) {
+        if (!is_pow2(odd - 1) && !is_pow2(odd + 1)) {
+            return false;
+        }
+        steps += 2;
+    }
+    if (steps > 2) {
+        return false;
+    }
+
+    Reg64 src64{src.id};
+    if (odd == 1) {
+        if (dst != src) {
+            as.mov(dst, src);                       // mov (dst), (src)
+        }
+    }
+    else if (odd == 3 || odd == 5 || odd == 9) {
+        as.lea(dst, Mem(src64, src64, odd - 1));    // lea (dst), [(src) + (src)*(odd-1)]
+    }
+    else {
+        // 2^k + 1:  (src << k) + src,   2^k - 1:  (src << k) - src
+        bool plus = is_pow2(odd - 1);
+        int k = __builtin_ctz(plus ? odd - 1 : odd + 1);
+
+        Reg32 orig = src;
+        if (dst == src) {
+            as.mov(edx, src);                       // mov edx, (src)
+            orig = edx;
+        }
+        else {
+            as.mov(dst, src);                       // mov (dst), (src)
+        }
+        as.shl(dst, k);                             // shl (dst), (k)
+        plus ? as.add(dst, orig) : as.sub(dst, orig);
+    }
+
+    if (shift > 0) {
+        as.shl(dst, shift);                         // shl (dst), (shift)
+    }
+    if (negate) {
+        as.neg(dst);                                // neg (dst)
+    }
+    return true;
+}
+
+// x / 2^k & x mod 2^k, truncating like idiv: a negative x gets 2^k - 1
+// added first (the bias, made from its sign bit), so it rounds toward zero
+//
+//   bias = (x >> 31) >>> (32 - k)
+//   x / 2^k   = (x + bias) >> k
+//   x mod 2^k = x - ((x + bias) & -2^k)
+//
+// The divisor's sign only flips the quotient. / -1 & mod -1 are left to
+// idiv (INT_MIN / -1 faults there).
+bool Backend::div_by_pow2(const IrInst& inst)
+{
+    if (!is_const(inst.args[1])) {
+        return false;
+    }
+    int32_t divisor = const_value(inst.args[1]);
+    if (divisor == INT32_MIN || divisor == -1) {
+        return false;
+    }
+
+    bool negate = divisor < 0;
+    uint32_t val = negate ? -divisor : divisor;
+    if (!is_pow2(val)) {
+        return false;
+    }
+    int k = __builtin_ctz(val);
+
+    Reg32 src = use(inst.args[0], eax);
+    Reg32 dst = def(inst.dst, eax);
+
+    if (k == 0) {
+        // x / 1,  x mod 1
+        if (inst.op == IrOp::DIV) {
+            if (dst != src) {
+                as.mov(dst, src);                   // mov (dst), (src)
+            }
+        }
+        else {
+            as.xor_(dst, dst);                      // xor (dst), (dst)
+        }
+        commit(inst.dst, dst);
+        return true;
+    }
+
+    as.mov(edx, src);                               // mov edx, (x)
+    as.sar(edx, 31);                                // sar edx, 31
+    as.shr(edx, 32 - k);                            // shr edx, (32-k)
+
+    if (inst.op == IrOp::DIV) {
+        if (dst != src) {
+            as.mov(dst, src);                       // mov (dst), (x)
+        }
+        as.add(dst, edx);                           // add (dst), edx
+        as.sar(dst, k);                             // sar (dst), (k)
+        if (negate) {
+            as.neg(dst);                            // neg (dst)
+        }
+    }
+    else {
+        as.lea(r11d, Mem(Reg64{src.id}, rdx, 1));   // lea r11d, [(x) + rdx]
+        as.and_(r11d, static_cast<int32_t>(~(val - 1)));  // and r11d, -(2^k)
+        if (dst != src) {
+            as.mov(dst, src);                       // mov (dst), (x)
+        }
+        as.sub(dst, r11d);                          // sub (dst), r11d
+    }
+
+    commit(inst.dst, dst);
+    return true;
+}
+
+// Magic number & shift for signed 32-bit division by a constant (Hacker's
+// Delight 10-1): for 2 <= |d| < 2^31, n / d = mulhi(n, magic) >> shift,
+// give or take the fixups in div_by_magic.
+static void signed_magic(int32_t d, int32_t& magic, int& shift)
+{
+    const uint32_t two31 = 0x80000000u;
+
+    uint32_t ad = (d < 0) ? -static_cast<uint32_t>(d) : d;
+    uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+    uint32_t anc = t - 1 - t % ad;          // |nc|
+    int p = 31;
+    uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+    uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+    uint32_t delta;
+
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    magic = static_cast<int32_t>(q2 + 1);
+    if (d < 0) {
+        magic = -magic;
+    }
+    shift = p - 32;
+}
+
+// x / d & x mod d for any other constant d, without idiv:
+//
+//   movsxd rax, x
+//   imul rax, rax, magic
+//   sar rax, 32 + shift          (the high half, shifted)
+//   (add / sub eax, x)           (when magic's sign came out wrong)
+//   mov edx, eax  shr edx, 31  add eax, edx    (round toward zero)
+//
+// & mod is then x - q * d.
+bool Backend::div_by_magic(const IrInst& inst)
+{
+    if (!is_const(inst.args[1])) {
+        return false;
+    }
+    int32_t divisor = const_value(inst.args[1]);
+    if (divisor == INT32_MIN || (divisor >= -1 && divisor <= 1)) {
+        return false;
+    }
+
+    int32_t magic;
+    int shift;
+    signed_magic(divisor, magic, shift);
+
+    // x stays in a register through the whole sequence
+    Reg32 src = use(inst.args[0], r11d);
+
+    as.movsxd(rax, src);                            // movsxd rax, (x)
+    as.imul(rax, rax, magic);                       // imul rax, rax, (magic)
+
+    bool fixup = (divisor > 0 && magic < 0) || (divisor < 0 && magic > 0);
+    if (fixup) {
+        as.sar(rax, 32);                            // sar rax, 32
+        (divisor > 0) ? as.add(eax, src) : as.sub(eax, src);
+        if (shift > 0) {
+            as.sar(eax, shift);                     // sar eax, (shift)
+        }
+    }
+    else {
+        as.sar(rax, 32 + shift);                    // sar rax, (32+shift)
+    }
+
+    as.mov(edx, eax);                               // mov edx, eax
+    as.shr(edx, 31);                                // shr edx, 31
+    as.add(eax, edx);                               // add eax, edx
+
+    Reg32 dst = def(inst.dst, eax);
+    if (inst.op == IrOp::DIV) {
+        if (dst != eax) {
+            as.mov(dst, eax);                       // mov (dst), eax
+        }
+    }
+    else {
+        as.imul(eax, eax, divisor);                 // imul eax, eax, (d)
+        if (dst == eax) {
+            as.neg(eax);                            // neg eax
+            as.add(eax, src);                       // add eax, (x)
+        }
+        else {
+            if (dst != src) {
+                as.mov(dst, src);                   // mov (dst), (x)
+            }
+            as.sub(dst, eax);                       // sub (dst), eax
+        }
+    }
+
+    commit(inst.dst, dst);
+    return true;
+}
+
+// square-and-multiply:  eax = base ^ exp  (0 for negative exponents)
+// base is worked on in edx, exp in r11d
+void Backend::emit_pow(const IrInst& inst)
+{
+    load(edx, inst.args[0]);
+    load(r11d, inst.args[1]);
+
+    Label loop_label = as.new_label();
+    Label skip_label = as.new_label();
+    Label done_label = as.new_label();
+
+    as.xor_(eax, eax);              // xor eax, eax
+    as.test(r11d, r11d);            // test r11d, r11d
+    as.jcc(Cond::L, done_label);    // jl done
+    as.inc(eax);                    // inc eax
+
+    as.bind(loop_label);
+    as.test(r11d, r11d);            // test r11d, r11d
+    as.jcc(Cond::E, done_label);    // je done
+    as.test(r11d, 1);               // test r11d, 1
+    as.jcc(Cond::E, skip_label);    // je skip
+    as.imul(eax, edx);              // imul eax, edx
+    as.bind(skip_label);
+    as.imul(edx, edx);              // imul edx, edx
+    as.sar(r11d, 1);                // sar r11d, 1
+    as.jmp(loop_label);             // jmp loop
+
+    as.bind(done_label);
+    if (loc(inst.dst).kind == Location::REG) {
+        as.mov(Reg32{loc(inst.dst).reg}, eax);      // mov (dst), eax
+    }
+    commit(inst.dst, eax);
+}
+
+static Cond cmp_cond(IrCmp cmp)
+{
+    switch (cmp) {
+    case IrCmp::LT:     return Cond::L;
+    case IrCmp::LE:     return Cond::LE;
+    case IrCmp::GT:     return Cond::G;
+    case IrCmp::GE:     return Cond::GE;
+    case IrCmp::EQ:     return Cond::E;
+    case IrCmp::NE:     return Cond::NE;
+    }
+    return Cond::E;
+}
+
+// the same comparison with the operands swapped
+static IrCmp swap_cmp(IrCmp cmp)
+{
+    switch (cmp) {
+    case IrCmp::LT:     return IrCmp::GT;
+    case IrCmp::LE:     return IrCmp::GE;
+    case IrCmp::GT:     return IrCmp::LT;
+    case IrCmp::GE:     return IrCmp::LE;
+    default:            return cmp;
+    }
+}
+
+void Backend::emit_cmp(const IrInst& inst)
+{
+    int a = inst.args[0];
+    int b = inst.args[1];
+    IrCmp cmp = static_cast<IrCmp>(inst.imm);
+
+    if (is_const(a) && !is_const(b)) {
+        std::swap(a, b);
+        cmp = swap_cmp(cmp);
+    }
+
+    Reg32 left = use(a, eax);
+    if (is_const(b)) {
+        as.cmp(left, const_value(b));               // cmp (a), (imm)
+    }
+    else {
+        as.cmp(left, use(b, edx));                  // cmp (a), (b)
+    }
+
+    if (loc(inst.dst).kind == Location::FLAGS) {
+        flags = cmp_cond(cmp);
+        return;
+    }
+
+    Reg32 dst = def(inst.dst, eax);
+    as.setcc(cmp_cond(cmp), Reg8{dst.id});          // set(cc) (dst8)
+    as.movzx(dst, Reg8{dst.id});                    // movzx (dst), (dst8)
+    commit(inst.dst, dst);
+}
+
+// runtime helpers are called directly, through their trampolines (the
+// argument is already in rdi)
+void Backend::emit_call(intptr_t helper)
+{
+    as.call(reinterpret_cast<const void*>(helper)); // call (helper)
+}
+
+// The statement's PrintDesc goes in the data segment, with every constant
+// argument formatted into its text now. The code only has to store the
+// other values into their PrintArgs & make the one call.
+void Backend::emit_print(const IrInst& inst)
+{
+    struct Piece {
+        PrintTag tag;
+        int vreg;           // (not PRINT_TEXT)
+        string text;
+    };
+    vector<Piece> pieces;
+
+    auto add_text = [&](const string& text) {
+        if (!pieces.empty() && pieces.back().tag == PRINT_TEXT) {
+            pieces.back().text += text;
+        }
+        else {
+            pieces.push_back(Piece{PRINT_TEXT, -1, text});
+        }
+    };
+
+    for (int val : inst.args) {
+        IrType type = fn.vregs[val];
+        if (!is_const(val)) {
+            PrintTag tag = (type == IrType::STR) ? PRINT_STR : (type == IrType::BOOL) ? PRINT_BOOL : PRINT_INT;
+            pieces.push_back(Piece{tag, val, ""});
+        }
+        else if (type == IrType::STR) {
+            add_text(reinterpret_cast<const char*>(loc(val).imm));
+        }
+        else if (type == IrType::BOOL) {
+            add_text(const_value(val) ? "true" : "false");
+        }
+        else {
+            add_text(std::to_string(const_value(val)));
+        }
+    }
+
+    // PrintDesc, the PrintArgs, then the text
+    size_t text_at = sizeof(PrintDesc) + pieces.size() * sizeof(PrintArg);
+    size_t text_len = 0;
+    for (auto& piece : pieces) {
+        text_len += piece.text.size();
+    }
+
+    vector<uint8_t> bytes(text_at + text_len, 0);
+    PrintDesc desc{static_cast<uint32_t>(pieces.size()), 0};
+    uint64_t max_len = 0;
+
+    size_t text = text_at;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        auto& piece = pieces[i];
+        PrintArg arg{piece.tag, 0, 0};
+        switch (piece.tag) {
+        case PRINT_TEXT:
+            arg.len = piece.text.size();
+            arg.value = text;
+            std::copy(piece.text.begin(), piece.text.end(), bytes.begin() + text);
+            text += piece.text.size();
+            max_len += piece.text.size();
+            break;
+        case PRINT_INT:
+            max_len += 11;      // -2147483648
+            break;
+        case PRINT_BOOL:
+            max_len += 5;
+            break;
+        case PRINT_STR:
+            max_len = UINT32_MAX;
+            break;
+        }
+        std::memcpy(&bytes[sizeof(PrintDesc) + i * sizeof(PrintArg)], &arg, sizeof(arg));
+    }
+    desc.max_len = std::min<uint64_t>(max_len, UINT32_MAX);
+    std::memcpy(&bytes[0], &desc, sizeof(desc));
+
+    int32_t at = as.add_data(bytes.size(), 8, bytes.data());
+
+    for (size_t i = 0; i < pieces.size(); i++) {
+        auto& piece = pieces[i];
+        Mem value = Mem::data(at + sizeof(PrintDesc) + i * sizeof(PrintArg) + offsetof(PrintArg, value));
+        switch (piece.tag) {
+        case PRINT_TEXT:
+            break;
+        case PRINT_STR:
+            load64(rax, piece.vreg);
+            as.mov(value, rax);                     // mov [rip + (arg)], rax
+            break;
+        default:
+            as.mov(value, use(piece.vreg, eax));    // mov [rip + (arg)], (val)
+            break;
+        }
+    }
+
+    as.lea(rdi, Mem::data(at));                     // lea rdi, [rip + (desc)]
+    emit_call(reinterpret_cast<intptr_t>(print_list));
+}
@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <climits>
+#include <numeric>
+
+#include "regalloc.h"
+
+using std::min, std::max;
+
+// caller saved first - they cost nothing to use
+static const vector<Reg64> caller_saved = { rcx, rsi, rdi, r8, r9, r10 };
+static const vector<Reg64> callee_saved = { rbx, r12, r13, r14, r15 };
+
+static void sort_unique(vector<int>& set)
+{
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+}
+
+static vector<int> set_union(const vector<int>& a, const vector<int>& b)
+{
+    vector<int> out;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    return out;
+}
+
+static vector<int> set_minus(const vector<int>& a, const vector<int>& b)
+{
+    vector<int> out;
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+    return out;
+}
+
+RegAllocator::RegAllocator(const IrFunction& fn)
+    : fn{fn}
+{}
+
+void RegAllocator::run()
+{
+    number();
+    liveness();
+    build_ranges();
+    coalesce();
+    allocate();
+}
+
+int RegAllocator::find(int vreg)
+{
+    while (group[vreg] != vreg) {
+        group[vreg] = group[group[vreg]];
+        vreg = group[vreg];
+    }
+    return vreg;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 LIFETIMES                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// blocks are walked back to front, so ranges only ever get added below the
+// ones already there (the list is reversed once it's complete)
+void RegAllocator::add_range(int vreg, int from, int to)
+{
+    auto& r = ranges[vreg];
+    if (!r.empty() && r.back().first <= to + 1) {
+        r.back().first = min(r.back().first, from);
+        r.back().second = max(r.back().second, to);
+    }
+    else {
+        r.push_back({from, to});
+    }
+}
+
+bool RegAllocator::intersect(const Ranges& a, const Ranges& b)
+{
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (a[i].second < b[j].first) {
+            i++;
+        }
+        else if (b[j].second < a[i].first) {
+            j++;
+        }
+        else {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto RegAllocator::merge(const Ranges& a, const Ranges& b) -> Ranges
+{
+    Ranges all;
+    std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(all));
+
+    Ranges out;
+    for (auto& range : all) {
+        if (!out.empty() && range.first <= out.back().second + 1) {
+            out.back().second = max(out.back().second, range.second);
+        }
+        else {
+            out.push_back(range);
+        }
+    }
+    return out;
+}
+
+// live on both sides of a call - a value only passed to it doesn't count
+bool RegAllocator::crosses_call(const Ranges& r) const
+{
+    for (auto& [from, to] : r) {
+        auto it = std::lower_bound(call_positions.begin(), call_positions.end(), from);
+        if (it != call_positions.end() && *it < to) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RegAllocator::number()
+{
+    block_start.assign(fn.blocks.size(), 0);
+    block_end.assign(fn.blocks.size(), 0);
+    locs.assign(fn.vregs.size(), Location{});
+
+    vector<int> uses(fn.vregs.size(), 0);
+    for (int b : fn.layout) {
+        for (auto& inst : fn.blocks[b].insts) {
+            for (int arg : inst.args) {
+                uses[arg]++;
+            }
+        }
+    }
+
+    int pos = 0;
+    for (int b : fn.layout) {
+        block_start[b] = pos;
+        auto& insts = fn.blocks[b].insts;
+        for (size_t i = 0; i < insts.size(); i++) {
+            auto& inst = insts[i];
+            if (inst.op == IrOp::CONST) {
+                locs[inst.dst] = Location{.kind = Location::CONST, .imm = inst.imm};
+            }
+            if (inst.op == IrOp::CMP && uses[inst.dst] == 1 && i + 1 < insts.size()
+                && insts[i + 1].op == IrOp::CBR && insts[i + 1].args[0] == inst.dst) {
+                locs[inst.dst] = Location{.kind = Location::FLAGS};
+            }
+            if (inst.op == IrOp::PRINT || inst.op == IrOp::READ) {
+                call_positions.push_back(pos);
+            }
+            pos += 2;
+        }
+        block_end[b] = pos - 2;
+    }
+}
+
+// live in / live out of every block. A PHI argument is live out of the
+// pred it comes from (not live in to the PHI's block).
+void RegAllocator::liveness()
+{
+    size_t n = fn.blocks.size();
+    vector<vector<int>> uses(n), defs(n), phi_uses(n);
+    vector<int> defined_in(fn.vregs.size(), -1);
+
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+        for (auto& inst : block.insts) {
+            if (inst.op == IrOp::PHI) {
+                for (size_t i = 0; i < inst.args.size(); i++) {
+                    if (!unallocated(inst.args[i])) {
+                        phi_uses[block.preds[i]].push_back(inst.args[i]);
+                    }
+                }
+            }
+            else {
+                for (int arg : inst.args) {
+                    if (!unallocated(arg) && defined_in[arg] != b) {
+                        uses[b].push_back(arg);
+                    }
+                }
+            }
+
+            if (inst.dst >= 0 && !unallocated(inst.dst)) {
+                defined_in[inst.dst] = b;
+                defs[b].push_back(inst.dst);
+            }
+        }
+        sort_unique(uses[b]);
+        sort_unique(defs[b]);
+    }
+    for (auto& set : phi_uses) {
+        sort_unique(set);
+    }
+
+    live_in.assign(n, {});
+    live_out.assign(n, {});
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = fn.layout.rbegin(); it != fn.layout.rend(); it++) {
+            int b = *it;
+
+            vector<int> out = phi_uses[b];
+            for (int succ : fn.blocks[b].succs) {
+                out = set_union(out, live_in[succ]);
+            }
+            vector<int> in = set_union(uses[b], set_minus(out, defs[b]));
+
+            if (in != live_in[b] || out != live_out[b]) {
+                live_in[b] = std::move(in);
+                live_out[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+}
+
+void RegAllocator::build_ranges()
+{
+    ranges.assign(fn.vregs.size(), {});
+    hints.assign(fn.vregs.size(), {});
+
+    for (auto it = fn.layout.rbegin(); it != fn.layout.rend(); it++) {
+        int b = *it;
+        int start = block_start[b];
+        auto& insts = fn.blocks[b].insts;
+
+        for (int v : live_out[b]) {
+            add_range(v, start, block_end[b] + 1);
+        }
+
+        int pos = block_end[b];
+        for (auto inst = insts.rbegin(); inst != insts.rend(); inst++, pos -= 2) {
+            int dst = inst->dst;
+            if (dst >= 0 && !unallocated(dst)) {
+                // (a PHI is defined on entry to its block)
+                int def = (inst->op == IrOp::PHI) ? start : pos + 1;
+                if (ranges[dst].empty()) {
+                    add_range(dst, def, def);
+                }
+                else {
+                    ranges[dst].back().first = def;
+                }
+            }
+
+            if (inst->op == IrOp::PHI) {
+                for (int arg : inst->args) {
+                    hints[dst].push_back(arg);
+                }
+                continue;
+            }
+
+            for (int arg : inst->args) {
+                if (!unallocated(arg)) {
+                    add_range(arg, start, pos);
+                }
+            }
+
+            // two address forms want the result where the first operand was
+            switch (inst->op) {
+            case IrOp::ADD:  case IrOp::SUB:  case IrOp::MUL:
+            case IrOp::NEG:  case IrOp::NOT:  case IrOp::COPY:
+                hints[dst].push_back(inst->args[0]);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    for (auto& r : ranges) {
+        std::reverse(r.begin(), r.end());
+    }
+}
+
+// Each PHI shares its lifetime (& so its location) with every argument it
+// doesn't clash with - the move on that edge disappears. Where it does
+// clash, the move writes the PHI's location at the end of the pred, so the
+// PHI is live there too.
+void RegAllocator::coalesce()
+{
+    group.resize(fn.vregs.size());
+    std::iota(group.begin(), group.end(), 0);
+
+    for (int b : fn.layout) {
+        for (auto& inst : fn.blocks[b].insts) {
+            if (inst.op != IrOp::PHI) {
+                break;
+            }
+            for (int arg : inst.args) {
+                if (unallocated(arg)) {
+                    continue;
+                }
+                int from = find(arg), to = find(inst.dst);
+                if (from != to && !intersect(ranges[from], ranges[to])) {
+                    ranges[to] = merge(ranges[to], ranges[from]);
+                    ranges[from].clear();
+                    group[from] = to;
+                }
+            }
+        }
+    }
+
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+        for (auto& inst : block.insts) {
+            if (inst.op != IrOp::PHI) {
+                break;
+            }
+            int phi = find(inst.dst);
+            for (size_t i = 0; i < inst.args.size(); i++) {
+                if (unallocated(inst.args[i]) || find(inst.args[i]) != phi) {
+                    int end = block_end[block.preds[i]];
+                    ranges[phi] = merge(ranges[phi], {{end, end + 1}});
+                }
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                LINEAR SCAN                                //
+///////////////////////////////////////////////////////////////////////////////
+
+void RegAllocator::allocate()
+{
+    vector<int> order;
+    for (size_t v = 0; v < fn.vregs.size(); v++) {
+        if (!unallocated(v) && find(v) == static_cast<int>(v) && !ranges[v].empty()) {
+            order.push_back(v);
+        }
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return ranges[a].front().first < ranges[b].front().first;
+    });
+
+    // hints collected per group
+    vector<vector<int>> group_hints(fn.vregs.size());
+    for (size_t v = 0; v < fn.vregs.size(); v++) {
+        for (int h : hints[v]) {
+            if (!unallocated(h)) {
+                group_hints[find(v)].push_back(h);
+            }
+        }
+    }
+
+    // the lifetimes on each register that haven't ended yet
+    vector<vector<int>> active(16);
+
+    auto spill = [&](int g) {
+        locs[g] = Location{.kind = Location::SLOT, .slot = slots++};
+    };
+
+    for (int g : order) {
+        int start = ranges[g].front().first;
+        int end = ranges[g].back().second;
+
+        for (auto& on_reg : active) {
+            std::erase_if(on_reg, [&](int a) { return ranges[a].back().second < start; });
+        }
+
+        vector<Reg64> allowed;
+        if (!crosses_call(ranges[g])) {
+            allowed = caller_saved;
+        }
+        allowed.insert(allowed.end(), callee_saved.begin(), callee_saved.end());
+
+        auto clashes = [&](Reg64 reg) {
+            for (int a : active[reg.id]) {
+                if (intersect(ranges[a], ranges[g])) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        int chosen = -1;
+
+        for (int h : group_hints[g]) {
+            auto& hint = locs[find(h)];
+            if (hint.kind != Location::REG) {
+                continue;
+            }
+            for (auto reg : allowed) {
+                if (reg.id == hint.reg && !clashes(reg)) {
+                    chosen = reg.id;
+                }
+            }
+            if (chosen >= 0) {
+                break;
+            }
+        }
+
+        for (size_t i = 0; chosen < 0 && i < allowed.size(); i++) {
+            if (!clashes(allowed[i])) {
+                chosen = allowed[i].id;
+            }
+        }
+
+        // out of registers - spill whatever (this or what's in the way) ends last
+        if (chosen < 0) {
+            int best_end = end;
+            for (auto reg : allowed) {
+                int first_end = INT_MAX;
+                for (int a : active[reg.id]) {
+                    if (intersect(ranges[a], ranges[g])) {
+                        first_end = min(first_end, ranges[a].back().second);
+                    }
+                }
+                if (first_end > best_end) {
+                    best_end = first_end;
+                    chosen = reg.id;
+                }
+            }
+
+            if (chosen < 0) {
+                spill(g);
+                continue;
+            }
+
+            std::erase_if(active[chosen], [&](int a) {
+                if (intersect(ranges[a], ranges[g])) {
+                    spill(a);
+                    return true;
+                }
+                return false;
+            });
+        }
+
+        locs[g] = Location{.kind = Location::REG, .reg = static_cast<uint8_t>(chosen)};
+        active[chosen].push_back(g);
+    }
+
+    // members of a group live wherever the group does
+    for (size_t v = 0; v < fn.vregs.size(); v++) {
+        if (!unallocated(v)) {
+            locs[v] = locs[find(v)];
+        }
+    }
+
+    for (auto reg : callee_saved) {
+        for (auto& loc : locs) {
+            if (loc.kind == Location::REG && loc.reg == reg.id) {
+                callee_used.push_back(reg);
+                break;
+            }
+        }
+    }
+}
@@ -121,4 +121,9 @@ string buf_getline(int line_number) {
     size_t first = line_starts[line_number-1];
     size_t last  = first + line_lengths[line_number-1];
     return string(buffer.begin()+first, buffer.begin()+last);
+}
+
+// return the number of lines in the buffer
+int buf_line_count() {
+    return line_lengths.size();
 }
\ No newline at end of file
@@ -303,6 +303,11 @@ IntegerNode::IntegerNode(long long int int_value)
     : int_value{int_value}
 {}
 
+long long int IntegerNode::get_value() const
+{
+    return int_value;
+}
+
 CNodeType IntegerNode::get_node_type() const
 {
     return CNODE_INT;
@@ -331,6 +336,11 @@ BoolNode::BoolNode(bool bool_val)
     : bool_val{bool_val}
 {}
 
+bool BoolNode::get_value() const
+{
+    return bool_val;
+}
+
 CNodeType BoolNode::get_node_type() const
 {
     return CNODE_BOOL;
@@ -345,6 +355,11 @@ VariableNode::VariableNode(string var_name)
     : var_name{var_name}
 {}
 
+const string& VariableNode::get_name() const
+{
+    return var_name;
+}
+
 CNodeType VariableNode::get_node_type() const
 {
     return CNODE_VAR;
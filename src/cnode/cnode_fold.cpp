@@ -0,0 +1,461 @@
+#include <climits>
+#include <memory>
+
+#include "cnode.h"
+
+using std::make_unique;
+
+// Constant folding & propagation
+//
+// Expressions are folded bottom up: once both sides of an operator are
+// literals it's evaluated here, with the same int4 semantics the generated
+// code has (wrapping arithmetic, truncating idiv, the square-and-multiply
+// power). Anything that would fault at run time (division by zero,
+// INT_MIN / -1) is left for run time.
+//
+// Statements are walked in order, tracking which variables hold a known
+// constant. An if merges what both branches agree on. A while forgets
+// everything its body assigns before looking at the condition, since the
+// condition & body run again after the body.
+
+void fold_constants(unique_ptr<CNode>& tree, FoldState& state)
+{
+    if (auto folded = tree->fold(state)) {
+        tree = std::move(folded);
+    }
+}
+
+// int4 & bool literals
+static bool literal(const CNode* node, int32_t& value)
+{
+    switch (node->get_node_type()) {
+    case CNODE_INT:
+        value = static_cast<int32_t>(static_cast<const IntegerNode*>(node)->get_value());
+        return true;
+    case CNODE_BOOL:
+        value = static_cast<const BoolNode*>(node)->get_value();
+        return true;
+    default:
+        return false;
+    }
+}
+
+// logical & relational expressions have a bool value
+static unique_ptr<CNode> make_literal(CNodeType type, int32_t value)
+{
+    if (type >= CNODE_OR && type <= CNODE_NOT_EQ) {
+        return make_unique<BoolNode>(value != 0);
+    }
+    return make_unique<IntegerNode>(value);
+}
+
+// a bool valued node - a bool literal, or a logical / relational expression
+static bool is_bool(const CNode* node)
+{
+    CNodeType type = node->get_node_type();
+    return type == CNODE_BOOL || (type >= CNODE_OR && type <= CNODE_NOT_EQ);
+}
+
+static unique_ptr<CNode> empty_block()
+{
+    return make_unique<StatementBlockNode>(vector<unique_ptr<CNode>>{});
+}
+
+// wrapping int4 arithmetic
+static int32_t wrap(uint32_t value)
+{
+    return static_cast<int32_t>(value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   CNODE                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+unique_ptr<CNode> CNode::fold(FoldState& state)
+{
+    return nullptr;
+}
+
+void CNode::assigned_vars(set<string>& vars) const
+{}
+
+///////////////////////////////////////////////////////////////////////////////
+//                              STATEMENT BLOCK                              //
+///////////////////////////////////////////////////////////////////////////////
+
+unique_ptr<CNode> StatementBlockNode::fold(FoldState& state)
+{
+    for (auto& statement : statements) {
+        fold_constants(statement, state);
+    }
+    return nullptr;
+}
+
+void StatementBlockNode::assigned_vars(set<string>& vars) const
+{
+    for (auto& statement : statements) {
+        statement->assigned_vars(vars);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                STATEMENTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// ============================== //
+//         Print Statement        //
+// ============================== //
+
+unique_ptr<CNode> PrintNode::fold(FoldState& state)
+{
+    for (auto& expr : expressions) {
+        fold_constants(expr, state);
+    }
+    return nullptr;
+}
+
+// ============================== //
+//         Read Statement         //
+// ============================== //
+
+unique_ptr<CNode> ReadNode::fold(FoldState& state)
+{
+    if (var->get_node_type() == CNODE_VAR) {
+        state.vars.erase(static_cast<VariableNode*>(var.get())->get_name());
+    }
+    return nullptr;
+}
+
+void ReadNode::assigned_vars(set<string>& vars) const
+{
+    if (var->get_node_type() == CNODE_VAR) {
+        vars.insert(static_cast<VariableNode*>(var.get())->get_name());
+    }
+}
+
+// ============================== //
+//          If Statement          //
+// ============================== //
+
+// a constant condition leaves just the branch taken
+unique_ptr<CNode> IfNode::fold(FoldState& state)
+{
+    fold_constants(logic_expr, state);
+
+    int32_t cond;
+    if (literal(logic_expr.get(), cond)) {
+        state.branches++;
+
+        auto& taken = cond ? if_body : else_stmt;
+        if (!taken) {
+            return empty_block();
+        }
+        fold_constants(taken, state);
+        return std::move(taken);
+    }
+
+    auto before = state.vars;
+    fold_constants(if_body, state);
+    auto after_then = std::move(state.vars);
+
+    state.vars = std::move(before);
+    if (else_stmt) {
+        fold_constants(else_stmt, state);
+    }
+
+    // only what both paths agree on is still known
+    std::erase_if(state.vars, [&](const auto& var) {
+        auto it = after_then.find(var.first);
+        return it == after_then.end() || it->second != var.second;
+    });
+    return nullptr;
+}
+
+void IfNode::assigned_vars(set<string>& vars) const
+{
+    if_body->assigned_vars(vars);
+    if (else_stmt) {
+        else_stmt->assigned_vars(vars);
+    }
+}
+
+// ============================== //
+//         Else Statement         //
+// ============================== //
+
+unique_ptr<CNode> ElseNode::fold(FoldState& state)
+{
+    fold_constants(else_body, state);
+    return nullptr;
+}
+
+void ElseNode::assigned_vars(set<string>& vars) const
+{
+    else_body->assigned_vars(vars);
+}
+
+// ============================== //
+//         While Statement        //
+// ============================== //
+
+// a condition that's false from the start drops the loop
+unique_ptr<CNode> WhileNode::fold(FoldState& state)
+{
+    set<string> assigned;
+    while_body->assigned_vars(assigned);
+    for (auto& name : assigned) {
+        state.vars.erase(name);
+    }
+
+    fold_constants(logic_expr, state);
+
+    int32_t cond;
+    if (literal(logic_expr.get(), cond) && !cond) {
+        state.branches++;
+        return empty_block();
+    }
+
+    // (the body may not run at all - what it learns stays inside)
+    auto before = state.vars;
+    fold_constants(while_body, state);
+    state.vars = std::move(before);
+    return nullptr;
+}
+
+void WhileNode::assigned_vars(set<string>& vars) const
+{
+    while_body->assigned_vars(vars);
+}
+
+// ============================== //
+// Variable Declaration Statement //
+// ============================== //
+
+unique_ptr<CNode> VarDeclareNode::fold(FoldState& state)
+{
+    state.vars[var_name] = 0;
+    return nullptr;
+}
+
+void VarDeclareNode::assigned_vars(set<string>& vars) const
+{
+    vars.insert(var_name);
+}
+
+// ============================== //
+//  Variable Assignment Statement //
+// ============================== //
+
+unique_ptr<CNode> VarAssignNode::fold(FoldState& state)
+{
+    fold_constants(expr, state);
+
+    int32_t value;
+    if (literal(expr.get(), value)) {
+        state.vars[var_name] = value;
+    }
+    else {
+        state.vars.erase(var_name);
+    }
+    return nullptr;
+}
+
+void VarAssignNode::assigned_vars(set<string>& vars) const
+{
+    vars.insert(var_name);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                EXPRESSIONS                                //
+///////////////////////////////////////////////////////////////////////////////
+
+unique_ptr<CNode> BinaryExpr::fold(FoldState& state)
+{
+    fold_constants(left_expr, state);
+    fold_constants(right_expr, state);
+
+    int32_t left, right, result;
+    if (literal(left_expr.get(), left) && literal(right_expr.get(), right)
+        && evaluate(left, right, result)) {
+        state.folded++;
+        return make_literal(get_node_type(), result);
+    }
+    return nullptr;
+}
+
+bool BinaryExpr::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    return false;
+}
+
+unique_ptr<CNode> UnaryExpr::fold(FoldState& state)
+{
+    fold_constants(val_expr, state);
+
+    int32_t val, result;
+    if (literal(val_expr.get(), val) && evaluate(val, result)) {
+        state.folded++;
+        return make_literal(get_node_type(), result);
+    }
+    return nullptr;
+}
+
+bool UnaryExpr::evaluate(int32_t val, int32_t& result) const
+{
+    return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                            LOGICAL EXPRESSIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+// A constant left side decides the short circuit on its own: either the
+// result is known, or it's just the right side - as long as that's a bool
+// already (an int4 right side still needs the Or / And to turn it into
+// one).
+
+// ============================== //
+//               Or               //
+// ============================== //
+
+unique_ptr<CNode> OrNode::fold(FoldState& state)
+{
+    fold_constants(left_expr, state);
+    fold_constants(right_expr, state);
+
+    int32_t left;
+    if (literal(left_expr.get(), left) && (left || is_bool(right_expr.get()))) {
+        state.folded++;
+        return left ? make_unique<BoolNode>(true) : std::move(right_expr);
+    }
+    return nullptr;
+}
+
+// ============================== //
+//               And              //
+// ============================== //
+
+unique_ptr<CNode> AndNode::fold(FoldState& state)
+{
+    fold_constants(left_expr, state);
+    fold_constants(right_expr, state);
+
+    int32_t left;
+    if (literal(left_expr.get(), left) && (!left || is_bool(right_expr.get()))) {
+        state.folded++;
+        return left ? std::move(right_expr) : make_unique<BoolNode>(false);
+    }
+    return nullptr;
+}
+
+// ============================== //
+//               Not              //
+// ============================== //
+
+bool NotNode::evaluate(int32_t val, int32_t& result) const
+{
+    result = val ^ 1;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                           RELATIONAL EXPRESSIONS                          //
+///////////////////////////////////////////////////////////////////////////////
+
+bool RelateExprNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    switch (type) {
+    case RelateExprType::LESS:            result = left < right;     break;
+    case RelateExprType::LESS_EQ:         result = left <= right;    break;
+    case RelateExprType::GREATER:         result = left > right;     break;
+    case RelateExprType::GREATER_EQ:      result = left >= right;    break;
+    case RelateExprType::EQUAL:           result = left == right;    break;
+    case RelateExprType::NOT_EQ:          result = left != right;    break;
+    }
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                           ARITHMETIC EXPRESSIONS                          //
+///////////////////////////////////////////////////////////////////////////////
+
+bool AddNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    result = wrap(static_cast<uint32_t>(left) + static_cast<uint32_t>(right));
+    return true;
+}
+
+bool SubtractNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    result = wrap(static_cast<uint32_t>(left) - static_cast<uint32_t>(right));
+    return true;
+}
+
+bool MultiplyNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    result = wrap(static_cast<uint32_t>(left) * static_cast<uint32_t>(right));
+    return true;
+}
+
+// idiv faults on these - keep the fault at run time
+bool DivideNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    if (right == 0 || (left == INT_MIN && right == -1)) {
+        return false;
+    }
+    result = left / right;
+    return true;
+}
+
+bool ModNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    if (right == 0 || (left == INT_MIN && right == -1)) {
+        return false;
+    }
+    result = left % right;
+    return true;
+}
+
+// square-and-multiply, as generated (0 for negative exponents)
+bool PowerNode::evaluate(int32_t left, int32_t right, int32_t& result) const
+{
+    uint32_t acc = 0;
+    if (right >= 0) {
+        uint32_t base = left;
+        acc = 1;
+        for (int32_t exp = right; exp != 0; exp >>= 1) {
+            if (exp & 1) {
+                acc *= base;
+            }
+            base *= base;
+        }
+    }
+    result = wrap(acc);
+    return true;
+}
+
+bool NegativeNode::evaluate(int32_t val, int32_t& result) const
+{
+    result = wrap(0u - static_cast<uint32_t>(val));
+    return true;
+}
+
+bool PositiveNode::evaluate(int32_t val, int32_t& result) const
+{
+    result = val;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  VALUES                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+unique_ptr<CNode> VariableNode::fold(FoldState& state)
+{
+    auto it = state.vars.find(var_name);
+    if (it == state.vars.end()) {
+        return nullptr;
+    }
+    state.propagated++;
+    return make_unique<IntegerNode>(it->second);
+}
@@ -0,0 +1,349 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "cnode.h"
+#include "ir.h"
+
+using std::cout;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   CNODE                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+// an expression used as a statement - evaluate & throw the value away
+void CNode::gen_ir(IrBuilder& ir)
+{
+    gen_ir_value(ir);
+}
+
+// statements don't have a value
+int CNode::gen_ir_value(IrBuilder& ir)
+{
+    cout << "ERROR: Statement used as an expression in code generation\n";
+    std::exit(1);
+}
+
+// a value used as a condition - test it
+void CNode::gen_ir_cond(IrBuilder& ir, int if_true, int if_false)
+{
+    ir.cbr(gen_ir_value(ir), if_true, if_false);
+}
+
+// a statement, with its source position on what it emits
+static void gen_statement(IrBuilder& ir, CNode& statement)
+{
+    ir.begin_statement(statement.get_line(), statement.get_col());
+    statement.gen_ir(ir);
+    ir.end_statement();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                              STATEMENT BLOCK                              //
+///////////////////////////////////////////////////////////////////////////////
+
+void StatementBlockNode::gen_ir(IrBuilder& ir)
+{
+    for (auto& statement : statements) {
+        gen_statement(ir, *statement);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                STATEMENTS                                 //
+///////////////////////////////////////////////////////////////////////////////
+
+// ============================== //
+//         Print Statement        //
+// ============================== //
+
+// one PRINT for the whole statement
+void PrintNode::gen_ir(IrBuilder& ir)
+{
+    vector<int> values;
+    for (auto& expr : expressions) {
+        values.push_back(expr->gen_ir_value(ir));
+    }
+    ir.emit_void(IrOp::PRINT, std::move(values));
+}
+
+// ============================== //
+//         Read Statement         //
+// ============================== //
+
+void ReadNode::gen_ir(IrBuilder& ir)
+{
+    // only variables can be read into
+    if (var->get_node_type() != CNODE_VAR) {
+        return;
+    }
+
+    int value = ir.emit(IrOp::READ, IrType::I32);
+    auto& var_name = static_cast<VariableNode*>(var.get())->get_name();
+    ir.emit_void(IrOp::STOREVAR, {value}, ir.var(var_name));
+}
+
+// ============================== //
+//          If Statement          //
+// ============================== //
+
+// (--instrument: each arm counts itself on the way in, --profile-use: a
+// rarely run arm goes out of line)
+void IfNode::gen_ir(IrBuilder& ir)
+{
+    int then_block = ir.new_block();
+    int else_block = else_stmt ? ir.new_block() : -1;
+    int end_block = ir.new_block();
+
+    logic_expr->gen_ir_cond(ir, then_block, else_stmt ? else_block : end_block);
+
+    ir.start_block(then_block);
+    ir.arm(false, line, col, then_block, else_stmt ? else_block : end_block);
+    int then_count = ir.add_counter(IrCounterKind::THEN, line, col);
+    ir.count(then_count);
+    ir.begin_counted(then_count);
+    gen_statement(ir, *if_body);
+    ir.end_counted();
+    ir.br(end_block);
+
+    if (else_stmt) {
+        ir.start_block(else_block);
+        ir.arm(true, line, col, else_block, end_block);
+        int else_count = ir.add_counter(IrCounterKind::ELSE, line, col);
+        ir.count(else_count);
+        ir.begin_counted(else_count);
+        gen_statement(ir, *else_stmt);
+        ir.end_counted();
+        ir.br(end_block);
+    }
+
+    ir.start_block(end_block);
+}
+
+// ============================== //
+//         Else Statement         //
+// ============================== //
+
+void ElseNode::gen_ir(IrBuilder& ir)
+{
+    gen_statement(ir, *else_body);
+}
+
+// ============================== //
+//         While Statement        //
+// ============================== //
+
+// (--instrument: the back edge counts the body's runs, --profile-use: a
+// hot loop gets more copies of its body, see IrLoop)
+void WhileNode::gen_ir(IrBuilder& ir)
+{
+    int header = ir.new_block();
+    ir.enter_loop(ir.current_block(), header);
+    ir.br(header);
+
+    ir.start_block(header);
+    int body = ir.new_block();
+    int exit = ir.new_block();
+    logic_expr->gen_ir_cond(ir, body, exit);
+
+    ir.start_block(body);
+    int body_count = ir.add_counter(IrCounterKind::LOOP, line, col);
+    ir.begin_loop_body(line);
+    ir.begin_counted(body_count);
+    gen_statement(ir, *while_body);
+    for (int copies = ir.loop_copies(); copies > 1; copies--) {
+        int copy = ir.new_block();
+        logic_expr->gen_ir_cond(ir, copy, exit);
+        ir.start_block(copy);
+        gen_statement(ir, *while_body);
+    }
+    ir.end_counted();
+    ir.count(body_count);
+    ir.end_loop_body();
+    ir.br(header);
+
+    ir.exit_loop(exit);
+    ir.start_block(exit);
+}
+
+// ============================== //
+// Variable Declaration Statement //
+// ============================== //
+
+void VarDeclareNode::gen_ir(IrBuilder& ir)
+{
+    int zero = ir.emit(IrOp::CONST, IrType::I32, {}, 0);
+    ir.emit_void(IrOp::STOREVAR, {zero}, ir.var(var_name));
+}
+
+// ============================== //
+//  Variable Assignment Statement //
+// ============================== //
+
+void VarAssignNode::gen_ir(IrBuilder& ir)
+{
+    int value = expr->gen_ir_value(ir);
+    ir.emit_void(IrOp::STOREVAR, {value}, ir.var(var_name));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                EXPRESSIONS                                //
+///////////////////////////////////////////////////////////////////////////////
+
+int BinaryExpr::gen_arith_ir(IrBuilder& ir, IrOp op)
+{
+    int left = left_expr->gen_ir_value(ir);
+    int right = right_expr->gen_ir_value(ir);
+    return ir.emit(op, IrType::I32, {left, right});
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                            LOGICAL EXPRESSIONS                            //
+///////////////////////////////////////////////////////////////////////////////
+
+// As conditions, Or / And short circuit by branching: the left side goes
+// straight to the target it decides, otherwise on to the right side. Not
+// just swaps the targets. As a value, the condition branches to a block
+// for each outcome & the result is a PHI of 1 & 0.
+
+static int bool_value(IrBuilder& ir, CNode& cond)
+{
+    int true_block = ir.new_block();
+    int false_block = ir.new_block();
+    int end_block = ir.new_block();
+    cond.gen_ir_cond(ir, true_block, false_block);
+
+    ir.start_block(true_block);
+    int one = ir.emit(IrOp::CONST, IrType::BOOL, {}, 1);
+    ir.br(end_block);
+
+    ir.start_block(false_block);
+    int zero = ir.emit(IrOp::CONST, IrType::BOOL, {}, 0);
+    ir.br(end_block);
+
+    ir.start_block(end_block);
+    return ir.emit(IrOp::PHI, IrType::BOOL, {one, zero});
+}
+
+// ============================== //
+//               Or               //
+// ============================== //
+
+int OrNode::gen_ir_value(IrBuilder& ir)
+{
+    return bool_value(ir, *this);
+}
+
+void OrNode::gen_ir_cond(IrBuilder& ir, int if_true, int if_false)
+{
+    int right_block = ir.new_block();
+    left_expr->gen_ir_cond(ir, if_true, right_block);
+
+    ir.start_block(right_block);
+    right_expr->gen_ir_cond(ir, if_true, if_false);
+}
+
+// ============================== //
+//               And              //
+// ============================== //
+
+int AndNode::gen_ir_value(IrBuilder& ir)
+{
+    return bool_value(ir, *this);
+}
+
+void AndNode::gen_ir_cond(IrBuilder& ir, int if_true, int if_false)
+{
+    int right_block = ir.new_block();
+    left_expr->gen_ir_cond(ir, right_block, if_false);
+
+    ir.start_block(right_block);
+    right_expr->gen_ir_cond(ir, if_true, if_false);
+}
+
+// ============================== //
+//               Not              //
+// ============================== //
+
+int NotNode::gen_ir_value(IrBuilder& ir)
+{
+    int val = val_expr->gen_ir_value(ir);
+    return ir.emit(IrOp::NOT, IrType::BOOL, {val});
+}
+
+void NotNode::gen_ir_cond(IrBuilder& ir, int if_true, int if_false)
+{
+    val_expr->gen_ir_cond(ir, if_false, if_true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                           RELATIONAL EXPRESSIONS                          //
+///////////////////////////////////////////////////////////////////////////////
+
+int RelateExprNode::gen_ir_value(IrBuilder& ir)
+{
+    IrCmp cmp = IrCmp::EQ;
+    switch (type) {
+    case RelateExprType::LESS:            cmp = IrCmp::LT;    break;
+    case RelateExprType::LESS_EQ:         cmp = IrCmp::LE;    break;
+    case RelateExprType::GREATER:         cmp = IrCmp::GT;    break;
+    case RelateExprType::GREATER_EQ:      cmp = IrCmp::GE;    break;
+    case RelateExprType::EQUAL:           cmp = IrCmp::EQ;    break;
+    case RelateExprType::NOT_EQ:          cmp = IrCmp::NE;    break;
+    }
+
+    int left = left_expr->gen_ir_value(ir);
+    int right = right_expr->gen_ir_value(ir);
+    return ir.emit(IrOp::CMP, IrType::BOOL, {left, right}, static_cast<int64_t>(cmp));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                           ARITHMETIC EXPRESSIONS                          //
+///////////////////////////////////////////////////////////////////////////////
+
+int AddNode::gen_ir_value(IrBuilder& ir)          {    return gen_arith_ir(ir, IrOp::ADD);    }
+int SubtractNode::gen_ir_value(IrBuilder& ir)     {    return gen_arith_ir(ir, IrOp::SUB);    }
+int MultiplyNode::gen_ir_value(IrBuilder& ir)     {    return gen_arith_ir(ir, IrOp::MUL);    }
+int DivideNode::gen_ir_value(IrBuilder& ir)       {    return gen_arith_ir(ir, IrOp::DIV);    }
+int ModNode::gen_ir_value(IrBuilder& ir)          {    return gen_arith_ir(ir, IrOp::MOD);    }
+int PowerNode::gen_ir_value(IrBuilder& ir)        {    return gen_arith_ir(ir, IrOp::POW);    }
+
+int NegativeNode::gen_ir_value(IrBuilder& ir)
+{
+    int val = val_expr->gen_ir_value(ir);
+    return ir.emit(IrOp::NEG, IrType::I32, {val});
+}
+
+int PositiveNode::gen_ir_value(IrBuilder& ir)
+{
+    return val_expr->gen_ir_value(ir);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  VALUES                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+// int4 - only the low 32 bits of a literal are kept
+int IntegerNode::gen_ir_value(IrBuilder& ir)
+{
+    return ir.emit(IrOp::CONST, IrType::I32, {}, static_cast<int32_t>(int_value));
+}
+
+int StringNode::gen_ir_value(IrBuilder& ir)
+{
+    return ir.emit(IrOp::CONST, IrType::STR, {}, reinterpret_cast<intptr_t>(string_val));
+}
+
+int BoolNode::gen_ir_value(IrBuilder& ir)
+{
+    return ir.emit(IrOp::CONST, IrType::BOOL, {}, bool_val ? 1 : 0);
+}
+
+void BoolNode::gen_ir_cond(IrBuilder& ir, int if_true, int if_false)
+{
+    ir.br(bool_val ? if_true : if_false);
+}
+
+int VariableNode::gen_ir_value(IrBuilder& ir)
+{
+    return ir.emit(IrOp::LOADVAR, IrType::I32, {}, ir.var(var_name));
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "codegen.h"
+#include "runtime.h"
+
+using std::cout, std::endl, std::vector;
+
+// Benchmark mode
+//
+// The code is compiled once & run `runs` times. Before each run the data
+// segment goes back to what it was at compile time (every variable 0
+// again) & read() starts over on a copy of stdin taken up front. Output is
+// still formatted, just never written. Each run is timed by the wall clock
+// & the time stamp counter; the first one pays for cold caches & page
+// faults, so min & median are the numbers to compare between builds.
+// --profile samples every run.
+
+// all of stdin, read before the first run
+static vector<char> capture_stdin()
+{
+    vector<char> input;
+    size_t len = 0;
+    for (;;) {
+        input.resize(len + (1 << 16));
+        ssize_t n = read(STDIN_FILENO, input.data() + len, input.size() - len);
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+    }
+    input.resize(len);
+    return input;
+}
+
+// nearest rank percentile of sorted samples
+static uint64_t percentile(const vector<uint64_t>& sorted, unsigned p)
+{
+    size_t rank = (sorted.size() * p + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_row(const char* name, vector<uint64_t>& samples, double scale)
+{
+    std::sort(samples.begin(), samples.end());
+    cout << "  " << std::left << std::setw(18) << name << std::right
+         << std::setw(14) << samples.front() * scale
+         << std::setw(14) << percentile(samples, 50) * scale
+         << std::setw(14) << percentile(samples, 99) * scale << "\n";
+}
+
+void Codegen::bench(unsigned runs, Profiler* profiler)
+{
+    vector<char> input = capture_stdin();
+    vector<uint64_t> wall(runs), cycles(runs);
+    vector<CounterValues> counted(runs);
+
+    for (unsigned i = 0; i < runs; i++) {
+        code.reset_data();
+        runtime_input(input.data(), input.size());
+        runtime_output(false, nullptr, true);
+
+        if (profiler) {
+            profiler->start(opts.profile_hz);
+        }
+        counters.start();
+        auto start = std::chrono::steady_clock::now();
+        _mm_lfence();
+        uint64_t tsc = __rdtsc();
+
+        reinterpret_cast<void(*)()>(code.exec_data())();
+
+        unsigned aux;
+        cycles[i] = __rdtscp(&aux) - tsc;
+        wall[i] = std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+        counted[i] = counters.stop();
+        if (profiler) {
+            profiler->stop();
+        }
+        runtime_finish();
+    }
+
+    // each counter's median, for the JSON report
+    CounterValues median;
+    vector<vector<uint64_t>> counter_samples(COUNTER_COUNT);
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (!counted[0].valid[c]) {
+            continue;
+        }
+        for (auto& values : counted) {
+            counter_samples[c].push_back(values.value[c]);
+        }
+        std::sort(counter_samples[c].begin(), counter_samples[c].end());
+        median.value[c] = percentile(counter_samples[c], 50);
+        median.valid[c] = true;
+    }
+
+    if (opts.counters_json) {
+        print_counter_report(&median);
+    }
+
+    cout << std::fixed << std::setprecision(3);
+
+    cout << "Compile phases (ms):\n";
+    uint64_t total = 0;
+    for (auto& phase : phases) {
+        cout << "  " << std::left << std::setw(18) << phase.name << std::right
+             << std::setw(14) << phase.ns / 1e6 << "\n";
+        total += phase.ns;
+    }
+    cout << "  " << std::left << std::setw(18) << "total" << std::right
+         << std::setw(14) << total / 1e6 << "\n";
+
+    cout << "Runs: " << runs << "\n"
+         << "  " << std::setw(18) << "" << std::setw(14) << "min"
+         << std::setw(14) << "median" << std::setw(14) << "p99" << "\n";
+    print_row("wall (us)", wall, 1e-3);
+    cout << std::setprecision(0);
+    print_row("cycles", cycles, 1);
+    if (opts.counters && !opts.counters_json) {
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            if (median.valid[c]) {
+                print_row(counter_name(Counter(c)), counter_samples[c], 1);
+            }
+        }
+    }
+
+    cout << std::defaultfloat << std::setprecision(6) << endl;
+
+    if (opts.counters && !opts.counters_json) {
+        print_counter_report(nullptr);
+    }
+}
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "codebuf.h"
+
+using std::cout;
+
+// round n up to a whole number of pages
+static size_t page_round(size_t n)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (n + page - 1) & ~(page - 1);
+}
+
+// map (or remap) one view of the code memfd
+static uint8_t* map_view(int fd, uint8_t* old_view, size_t old_size, size_t new_size, int prot)
+{
+    void* mem;
+    if (old_view == nullptr) {
+        mem = mmap(0, new_size, prot, MAP_SHARED, fd, 0);
+    }
+    else {
+        mem = mremap(old_view, old_size, new_size, MREMAP_MAYMOVE);
+    }
+
+    if (mem == MAP_FAILED) {
+        cout << "ERROR: Could not map " << new_size << " bytes for generated code\n";
+        std::exit(1);
+    }
+
+    return static_cast<uint8_t*>(mem);
+}
+
+CodeBuffer::CodeBuffer(size_t initial_capacity)
+    : capacity{page_round(initial_capacity)}
+{
+    fd = memfd_create("ncc-code", MFD_CLOEXEC);
+    if (fd == -1 || ftruncate(fd, capacity) == -1) {
+        cout << "ERROR: Could not create memory for generated code\n";
+        std::exit(1);
+    }
+
+    prog = map_view(fd, nullptr, 0, capacity, PROT_READ | PROT_WRITE);
+}
+
+CodeBuffer::~CodeBuffer()
+{
+    munmap(prog, capacity);
+    if (exec != nullptr) {
+        munmap(exec - data_pages, data_pages + capacity);
+    }
+    close(fd);
+}
+
+// Grow geometrically (at least doubling) until `needed` bytes fit. The kernel
+// is free to move the view, which is fine since nothing holds on to pointers
+// into the buffer across emits.
+void CodeBuffer::grow(size_t needed)
+{
+    size_t new_capacity = capacity;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    new_capacity = page_round(new_capacity);
+
+    if (ftruncate(fd, new_capacity) == -1) {
+        cout << "ERROR: Could not grow generated code to " << new_capacity << " bytes\n";
+        std::exit(1);
+    }
+
+    prog = map_view(fd, prog, capacity, new_capacity, PROT_READ | PROT_WRITE);
+    capacity = new_capacity;
+}
+
+size_t CodeBuffer::add_data(size_t n, size_t align, const void* init)
+{
+    size_t at = (data_init.size() + align - 1) / align * align;
+    data_init.resize(at + n, 0);
+    if (init != nullptr) {
+        std::memcpy(&data_init[at], init, n);
+    }
+    return at;
+}
+
+long CodeBuffer::data_offset(size_t at) const
+{
+    return static_cast<long>(at) - static_cast<long>(page_round(data_init.size()));
+}
+
+// One reservation for both, so they're adjacent: the data pages first (a
+// private anonymous mapping, filled in here), then the code memfd on top.
+void CodeBuffer::finalize()
+{
+    final_size = size;
+    data_pages = page_round(data_init.size());
+
+    void* region = mmap(0, data_pages + capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        cout << "ERROR: Could not map " << data_pages + capacity << " bytes for generated code\n";
+        std::exit(1);
+    }
+    uint8_t* base = static_cast<uint8_t*>(region);
+
+    if (data_pages > 0) {
+        void* mem = mmap(base, data_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (mem == MAP_FAILED) {
+            cout << "ERROR: Could not map " << data_pages << " bytes for program data\n";
+            std::exit(1);
+        }
+        std::memcpy(base, data_init.data(), data_init.size());
+    }
+
+    void* mem = mmap(base + data_pages, capacity, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (mem == MAP_FAILED) {
+        cout << "ERROR: Could not map " << capacity << " bytes for generated code\n";
+        std::exit(1);
+    }
+
+    data_view = base;
+    exec = base + data_pages;
+}
+
+void CodeBuffer::reset_data()
+{
+    if (!data_init.empty()) {
+        std::memcpy(data_view, data_init.data(), data_init.size());
+    }
+}
@@ -1,54 +1,290 @@
 #include <iostream>
 #include <iomanip>
+#include <chrono>
+#include <cstdlib>
 
 #include <vector>
-#include <sys/mman.h>
 
 #include "parser.h"
 #include "codegen.h"
+#include "backend.h"
+#include "ir.h"
+#include "runtime.h"
 
 #include "disasm.h"
 
 using std::cout, std::endl, std::vector;
 
-Codegen::Codegen(Parser& parser, SymbolTable& symtbl)
+Codegen::Codegen(Parser& parser, SymbolTable& symtbl, const Options& opts)
     : parser{parser}
     , symtbl{symtbl}
+    , opts{opts}
 {
-    prog = (char *) mmap(0, 50000,
-        PROT_EXEC | PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANONYMOUS, -1 , 0);
+    as.set_loop_align(opts.loop_align);
+    as.set_peephole(opts.peephole);
+
+    if (opts.counters) {
+        counters.open();
+    }
 }
 
-Codegen::~Codegen()
+void Codegen::generate(unique_ptr<CNode> code_tree)
 {
-    munmap(0, 50000);
+    // each phase's time (& counters), from the end of the last one
+    std::chrono::steady_clock::time_point last;
+    auto phase_start = [&] {
+        counters.start();
+        last = std::chrono::steady_clock::now();
+    };
+    auto phase_done = [&](const char* name) {
+        auto now = std::chrono::steady_clock::now();
+        CounterValues counted = counters.stop();
+        phases.push_back({name, static_cast<uint64_t>(std::chrono::nanoseconds(now - last).count()), counted});
+        phase_start();
+    };
+
+    phase_start();
+
+    if (opts.fold) {
+        fold_constants(code_tree, fold_stats);
+    }
+    phase_done("fold");
+
+    IrFunction fn;
+    IrBuilder ir{fn, symtbl};
+    if (opts.instrument) {
+        ir.instrument();
+    }
+    IrProfile profile;
+    if (opts.profile_use) {
+        if (!ir_read_profile(opts.profile_use, profile)) {
+            std::exit(1);
+        }
+        ir.use_profile(profile, profile_stats);
+    }
+    code_tree->gen_ir(ir);
+    ir.ret();
+    phase_done("ir build");
+
+    if (opts.strength_reduce) {
+        ir_reduce_powers(fn, strength_stats);
+    }
+    ir_promote_loop_vars(fn, opts.loop_regs);
+    ir_check(fn, "loop variable promotion", false);
+    if (opts.licm) {
+        ir_hoist_invariants(fn, hoisted);
+    }
+    if (opts.dce) {
+        ir_eliminate_dead_code(fn, dce_stats);
+    }
+    ir_split_critical_edges(fn);
+    ir_layout_cold_arms(fn);
+    phase_done("ir passes");
+
+    if (opts.dump_ir) {
+        ir_dump(fn);
+    }
+    ir_check(fn, "the ir passes", true);
+
+    phase_start();
+    Backend backend{fn, as, opts.strength_reduce ? &strength_stats : nullptr};
+    backend.emit();
+    phase_done("backend");
+    as.finalize();
+    phase_done("assemble");
+    counters.stop();
+
+    auto& marks = backend.source_marks();
+    for (size_t i = 0; i + 1 < marks.size(); i++) {
+        source_ranges.push_back(SourceRange{as.mark_offset(marks[i].mark), as.mark_offset(marks[i + 1].mark),
+                                            marks[i].line, marks[i].col, marks[i].region});
+    }
+    regions = fn.regions;
+    lines = line_table(source_ranges);
+
+    exec_counters = fn.counters;
+    counted_statements = fn.counted;
+    counters_offset = backend.counters_offset();
+
+    if (opts.opt_report) {
+        print_opt_report();
+    }
 }
 
-void Codegen::generate(unique_ptr<CNode> code_tree)
+void Codegen::print_opt_report() const
 {
-    code_tree->gen_node_code(prog, p_offset, symtbl);
+    cout << "Constant folding:\n";
+    if (!opts.fold) {
+        cout << "  (disabled)\n";
+    }
+    else {
+        cout << "  " << fold_stats.folded << " expressions folded, "
+             << fold_stats.propagated << " variable uses propagated, "
+             << fold_stats.branches << " constant conditions\n";
+    }
+
+    cout << "Loop invariants:\n";
+    if (!opts.licm) {
+        cout << "  (disabled)\n";
+    }
+    else {
+        cout << "  " << hoisted << " instructions hoisted\n";
+    }
 
-    prog[p_offset++] = 0xC3; // RET
+    cout << "Dead code:\n";
+    if (!opts.dce) {
+        cout << "  (disabled)\n";
+    }
+    else {
+        cout << "  " << dce_stats.branches << " constant branches, "
+             << dce_stats.blocks << " unreachable blocks, "
+             << dce_stats.stores << " dead stores (" << dce_stats.zero_stores << " of 0), "
+             << dce_stats.values << " unused values\n";
+    }
+
+    cout << "Strength reduction:\n";
+    if (!opts.strength_reduce) {
+        cout << "  (disabled)\n";
+    }
+    else {
+        cout << "  " << strength_stats.pow << " powers unrolled, "
+             << strength_stats.mul << " multiplies, "
+             << strength_stats.div << " divisions, "
+             << strength_stats.mod << " mods\n";
+    }
+
+    cout << "Profile:\n";
+    if (!opts.profile_use) {
+        cout << "  (not used)\n";
+    }
+    else {
+        cout << "  " << profile_stats.cold_arms << " cold if arms moved out of line, "
+             << profile_stats.hot_loops << " hot loops aligned, "
+             << profile_stats.unrolled << " unrolled (" << profile_stats.copies << " body copies added)\n";
+    }
+
+    cout << "Peephole:\n";
+    if (!opts.peephole) {
+        cout << "  (disabled)\n";
+    }
+
+    unsigned insns = 0;
+    size_t bytes = 0;
+    for (auto& stat : as.peephole_report()) {
+        cout << "  " << std::left << std::setw(16) << stat.name << std::right
+             << std::setw(6) << stat.hits << " hits "
+             << std::setw(6) << stat.insns_removed << " insns "
+             << std::setw(8) << stat.bytes_removed << " bytes\n";
+        insns += stat.insns_removed;
+        bytes += stat.bytes_removed;
+    }
+    if (opts.peephole) {
+        cout << "  total: " << insns << " insns, " << bytes << " bytes removed\n";
+    }
 }
 
 void Codegen::run()
 {
-    cout << "Code size: " << p_offset << " bytes.\n";
+    cout << "Code size: " << code.code_size() << " bytes.\n";
+
+    if (opts.perf_map || opts.jitdump) {
+        string file = opts.filepath;
+        auto symbols = jit_symbols(source_ranges, regions, code.code_size(), file.substr(file.rfind('/') + 1));
+        if (opts.perf_map) {
+            write_perf_map(code.exec_data(), symbols);
+        }
+        if (opts.jitdump) {
+            write_jitdump(code.exec_data(), symbols, source_ranges, file);
+        }
+    }
+
+    // (sampling stops before any report is printed)
+    Profiler profiler{code.exec_data(), code.code_size()};
+    Profiler* profiling = opts.profile_hz > 0 ? &profiler : nullptr;
+
+    if (opts.bench > 0) {
+        bench(opts.bench, profiling);
+        if (profiling) {
+            profiler.report(lines);
+        }
+        if (opts.instrument) {
+            report_counts();
+        }
+        return;
+    }
 
     // DEBUGGING PURPOSES REMOVE THIS 
     // cout << "\n\nGENERATED CODE:\n";
-    // for (int i = 0; i < p_offset; i++) {
-    //     cout << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(prog[i] & 0xFF) << "\n";
+    // for (size_t i = 0; i < code.code_size(); i++) {
+    //     cout << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(code.data()[i]) << "\n";
     // }
     // cout << "END GEN CODE ----\n\n" << std::dec;
     // ------------------------------
 
-    // disassemble((unsigned char *)prog, p_offset);  cout << "\n";
+    // disassemble(code.data(), code.code_size());  cout << "\n";
 
-    cout << "Code execution:\n";
+    cout << "Code execution:\n" << std::flush;
 
-    reinterpret_cast<void(*)()>(prog)();
+    runtime_output(opts.async_output, opts.output_path);
+    if (profiling) {
+        profiler.start(opts.profile_hz);
+    }
+    counters.start();
+    reinterpret_cast<void(*)()>(code.exec_data())();
+    CounterValues counted = counters.stop();
+    profiler.stop();
+    runtime_finish();
 
     cout << '\n' << endl;
+
+    if (opts.counters) {
+        print_counter_report(&counted);
+    }
+    if (profiling) {
+        profiler.report(lines);
+    }
+    if (opts.instrument) {
+        report_counts();
+    }
+}
+
+void Codegen::print_counter_report(const CounterValues* program) const
+{
+    if (opts.counters_json) {
+        if (!counters.available()) {
+            cout << "{\"error\": \"" << counters.error() << "\"}" << endl;
+            return;
+        }
+        cout << "{";
+        if (program) {
+            cout << "\"program\": ";
+            print_counters_json(*program);
+            cout << ", ";
+        }
+        cout << "\"compile\": {";
+        for (size_t i = 0; i < phases.size(); i++) {
+            cout << (i ? ", " : "") << "\"" << phases[i].name << "\": ";
+            print_counters_json(phases[i].counters);
+        }
+        cout << "}}" << endl;
+        return;
+    }
+
+    if (!counters.available()) {
+        cout << "Counters: unavailable (" << counters.error() << ")" << endl;
+        return;
+    }
+    if (!counters.error().empty()) {
+        cout << "Counters: some unavailable (" << counters.error() << ")\n";
+    }
+    if (program) {
+        cout << "Counters (program):\n";
+        print_counters(*program, "  ");
+    }
+    cout << "Counters (compile):\n";
+    for (auto& phase : phases) {
+        cout << "  " << phase.name << ":\n";
+        print_counters(phase.counters, "    ");
+    }
+    cout << endl;
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "codegen.h"
+#include "bufio.h"
+
+using std::cout, std::string;
+
+// Instrumented runs (--instrument)
+//
+// The counters are in the data segment, so they're read straight out of
+// it after the run. The listing is every line of the source with the
+// count of the statements starting on it ("-" for none), & under each if
+// / while line how its arms went / how often its body ran. The counts
+// file has the same, one record per line:
+//
+//   # ncc counts <source path>
+//   <entry|then|else|loop> <line> <col> <count>     a counter (if / while position)
+//   stmt <line> <col> <count>                       a statement
+//
+// An if without an else has no counter for not taking it - that's the
+// if's own count less the then arm's.
+
+using Position = std::pair<int, int>;
+
+void Codegen::report_counts() const
+{
+    auto values = reinterpret_cast<const uint64_t*>(code.data_segment() + counters_offset);
+
+    std::map<Position, uint64_t> statement_count;
+    std::map<int, uint64_t> line_count;
+    for (auto& statement : counted_statements) {
+        uint64_t count = values[statement.counter];
+        statement_count[{statement.line, statement.col}] = count;
+        line_count[statement.line] = std::max(line_count[statement.line], count);
+    }
+
+    // each if's arms & each loop, by line (the then arm's counter is
+    // always just before its else arm's)
+    std::multimap<int, string> notes;
+    for (size_t i = 0; i < exec_counters.size(); i++) {
+        auto& counter = exec_counters[i];
+        Position at{counter.line, counter.col};
+        string note;
+        if (counter.kind == IrCounterKind::THEN) {
+            bool has_else = i + 1 < exec_counters.size() && exec_counters[i + 1].kind == IrCounterKind::ELSE
+                            && exec_counters[i + 1].line == counter.line && exec_counters[i + 1].col == counter.col;
+            uint64_t taken = values[i];
+            uint64_t not_taken = has_else ? values[i + 1] : statement_count[at] - taken;
+            note = "if " + std::to_string(counter.line) + ":" + std::to_string(counter.col)
+                   + ": then " + std::to_string(taken)
+                   + (has_else ? ", else " : ", not taken ") + std::to_string(not_taken);
+        }
+        else if (counter.kind == IrCounterKind::LOOP) {
+            note = "while " + std::to_string(counter.line) + ":" + std::to_string(counter.col)
+                   + ": body ran " + std::to_string(values[i]) + " times";
+        }
+        if (!note.empty()) {
+            notes.insert({counter.line, note});
+        }
+    }
+
+    cout << "Execution counts:\n";
+    for (int line = 1; line <= buf_line_count(); line++) {
+        string text = buf_getline(line);
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+            text.pop_back();
+        }
+
+        auto count = line_count.find(line);
+        cout << std::setw(12);
+        if (count != line_count.end()) {
+            cout << count->second;
+        }
+        else {
+            cout << "-";
+        }
+        cout << ":" << std::setw(5) << line << ":" << text << "\n";
+
+        auto [first, last] = notes.equal_range(line);
+        for (auto it = first; it != last; it++) {
+            cout << std::setw(12) << "" << " " << std::setw(5) << "" << "  " << it->second << "\n";
+        }
+    }
+    cout << "\n";
+
+    string path = opts.counts_path ? opts.counts_path : string{opts.filepath} + ".counts";
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        cout << "ERROR: Could not write " << path << "\n";
+        return;
+    }
+    std::fprintf(file, "# ncc counts %s\n", opts.filepath);
+    for (size_t i = 0; i < exec_counters.size(); i++) {
+        auto& counter = exec_counters[i];
+        std::fprintf(file, "%s %d %d %lu\n", ir_counter_kind_name(counter.kind), counter.line, counter.col, values[i]);
+    }
+    for (auto& [at, count] : statement_count) {
+        std::fprintf(file, "stmt %d %d %lu\n", at.first, at.second, count);
+    }
+    std::fclose(file);
+    cout << "Counts written to " << path << "\n";
+}
@@ -0,0 +1,294 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "ir.h"
+
+using std::cout;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                 FUNCTION                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+int IrFunction::new_vreg(IrType type)
+{
+    vregs.push_back(type);
+    return vregs.size() - 1;
+}
+
+int IrFunction::new_block()
+{
+    blocks.emplace_back();
+    return blocks.size() - 1;
+}
+
+void IrFunction::add_edge(int from, int to)
+{
+    blocks[from].succs.push_back(to);
+    blocks[to].preds.push_back(from);
+}
+
+// (after the passes that move instructions around - a broken function is a
+// bug in ncc, & the backend would quietly drop PHI moves from it)
+void ir_check(const IrFunction& fn, const char* after, bool edges_split)
+{
+    auto fail = [&](const IrInst& inst, int b, const char* what) {
+        cout << "ERROR: Phi v" << inst.dst << " in block b" << b << " " << what << " after " << after
+             << " in code generation\n";
+        std::exit(1);
+    };
+
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+        bool past_phis = false;
+        for (auto& inst : block.insts) {
+            if (inst.op != IrOp::PHI) {
+                past_phis = true;
+                continue;
+            }
+            if (past_phis) {
+                fail(inst, b, "comes after a non-phi");
+            }
+            if (inst.args.size() != block.preds.size()) {
+                fail(inst, b, "doesn't have an argument per pred");
+            }
+            // (the moves for an edge go at the end of its pred, which a
+            // CBR's other edge would run too)
+            for (int pred : block.preds) {
+                if (edges_split && fn.blocks[pred].insts.back().op == IrOp::CBR) {
+                    fail(inst, b, "has a pred ending in a cbr");
+                }
+            }
+        }
+    }
+}
+
+const char* ir_op_name(IrOp op)
+{
+    switch (op) {
+    case IrOp::CONST:       return "const";
+    case IrOp::LOADVAR:     return "loadvar";
+    case IrOp::STOREVAR:    return "storevar";
+    case IrOp::ADD:         return "add";
+    case IrOp::SUB:         return "sub";
+    case IrOp::MUL:         return "mul";
+    case IrOp::DIV:         return "div";
+    case IrOp::MOD:         return "mod";
+    case IrOp::POW:         return "pow";
+    case IrOp::NEG:         return "neg";
+    case IrOp::CMP:         return "cmp";
+    case IrOp::NOT:         return "not";
+    case IrOp::PHI:         return "phi";
+    case IrOp::COPY:        return "copy";
+    case IrOp::PRINT:       return "print";
+    case IrOp::READ:        return "read";
+    case IrOp::BR:          return "br";
+    case IrOp::CBR:         return "cbr";
+    case IrOp::RET:         return "ret";
+    case IrOp::COUNT:       return "count";
+    }
+    return "?";
+}
+
+const char* ir_type_name(IrType type)
+{
+    switch (type) {
+    case IrType::VOID:      return "void";
+    case IrType::I32:       return "i32";
+    case IrType::BOOL:      return "bool";
+    case IrType::STR:       return "str";
+    }
+    return "?";
+}
+
+const char* ir_cmp_name(IrCmp cmp)
+{
+    switch (cmp) {
+    case IrCmp::LT:     return "<";
+    case IrCmp::LE:     return "<=";
+    case IrCmp::GT:     return ">";
+    case IrCmp::GE:     return ">=";
+    case IrCmp::EQ:     return "=";
+    case IrCmp::NE:     return "~=";
+    }
+    return "?";
+}
+
+bool ir_is_terminator(IrOp op)
+{
+    return op == IrOp::BR || op == IrOp::CBR || op == IrOp::RET;
+}
+
+const char* ir_counter_kind_name(IrCounterKind kind)
+{
+    switch (kind) {
+    case IrCounterKind::ENTRY:  return "entry";
+    case IrCounterKind::THEN:   return "then";
+    case IrCounterKind::ELSE:   return "else";
+    case IrCounterKind::LOOP:   return "loop";
+    }
+    return "?";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  BUILDER                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+IrBuilder::IrBuilder(IrFunction& fn, SymbolTable& symtbl)
+    : fn{fn}
+    , symtbl{symtbl}
+{
+    start_block(new_block());
+}
+
+int IrBuilder::new_block()
+{
+    return fn.new_block();
+}
+
+void IrBuilder::start_block(int b)
+{
+    block = b;
+    fn.layout.push_back(b);
+}
+
+int IrBuilder::emit(IrOp op, IrType type, vector<int> args, int64_t imm)
+{
+    int dst = fn.new_vreg(type);
+    fn.blocks[block].insts.push_back(IrInst{op, dst, std::move(args), imm, line, col, region});
+    return dst;
+}
+
+void IrBuilder::emit_void(IrOp op, vector<int> args, int64_t imm)
+{
+    fn.blocks[block].insts.push_back(IrInst{op, -1, std::move(args), imm, line, col, region});
+}
+
+void IrBuilder::br(int target)
+{
+    emit_void(IrOp::BR);
+    fn.add_edge(block, target);
+}
+
+void IrBuilder::cbr(int cond, int if_true, int if_false)
+{
+    emit_void(IrOp::CBR, {cond});
+    fn.add_edge(block, if_true);
+    fn.add_edge(block, if_false);
+}
+
+void IrBuilder::ret()
+{
+    emit_void(IrOp::RET);
+}
+
+// index of a variable in the function's var table, added on first use
+int IrBuilder::var(const string& name)
+{
+    auto it = var_index.find(name);
+    if (it != var_index.end()) {
+        return it->second;
+    }
+
+    if (!symtbl.symbolExists(name)) {
+        cout << "ERROR: Unknown variable " << name << " in code generation\n";
+        std::exit(1);
+    }
+
+    fn.vars.push_back(IrVar{name});
+    var_index[name] = fn.vars.size() - 1;
+    return fn.vars.size() - 1;
+}
+
+// (--profile-use: a hot loop's header gets aligned)
+void IrBuilder::enter_loop(int preheader, int header)
+{
+    int depth = open_loops.size() + 1;
+    unsigned align = 0;
+    if (hot_loop(line, col)) {
+        align = hot_loop_align;
+        profile_stats->hot_loops++;
+    }
+    fn.loops.push_back(IrLoop{preheader, header, -1, -1, depth, line, col, align});
+    open_loops.push_back(fn.loops.size() - 1);
+}
+
+void IrBuilder::exit_loop(int exit)
+{
+    fn.loops[open_loops.back()].exit = exit;
+    fn.loops[open_loops.back()].end = fn.blocks.size();
+    open_loops.pop_back();
+}
+
+// a top level statement (outside every loop) starts a region of its own
+void IrBuilder::begin_statement(int stmt_line, int stmt_col)
+{
+    outer_positions.push_back({line, col});
+    if (stmt_line != 0) {
+        line = stmt_line;
+        col = stmt_col;
+    }
+    if (outer_positions.size() == 1 && outer_regions.empty()) {
+        fn.regions.push_back(IrRegion{line, false});
+        region = fn.regions.size() - 1;
+    }
+    if (counter >= 0 && stmt_line != 0) {
+        fn.counted.push_back(IrCounted{stmt_line, stmt_col, counter});
+    }
+}
+
+void IrBuilder::end_statement()
+{
+    line = outer_positions.back().first;
+    col = outer_positions.back().second;
+    outer_positions.pop_back();
+}
+
+void IrBuilder::begin_loop_body(int while_line)
+{
+    outer_regions.push_back(region);
+    fn.regions.push_back(IrRegion{while_line, true});
+    region = fn.regions.size() - 1;
+}
+
+void IrBuilder::end_loop_body()
+{
+    region = outer_regions.back();
+    outer_regions.pop_back();
+}
+
+void IrBuilder::instrument()
+{
+    instrumenting = true;
+    counter = add_counter(IrCounterKind::ENTRY, 0, 0);
+    count(counter);
+}
+
+int IrBuilder::add_counter(IrCounterKind kind, int at_line, int at_col)
+{
+    if (!instrumenting) {
+        return -1;
+    }
+    fn.counters.push_back(IrCounter{kind, at_line, at_col});
+    return fn.counters.size() - 1;
+}
+
+void IrBuilder::count(int c)
+{
+    if (c >= 0) {
+        emit_void(IrOp::COUNT, {}, c);
+    }
+}
+
+void IrBuilder::begin_counted(int c)
+{
+    outer_counters.push_back(counter);
+    if (c >= 0) {
+        counter = c;
+    }
+}
+
+void IrBuilder::end_counted()
+{
+    counter = outer_counters.back();
+    outer_counters.pop_back();
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+
+#include "ir.h"
+
+// The new block for the edge into the block next in the layout goes right
+// after the one the edge leaves, so a fall through stays a fall through -
+// the block for any other edge goes to the end of the layout, out of its
+// way. (Without a fall through to keep, they all go right after it.) The
+// edge keeps its slot in both blocks' lists, so PHI arguments stay lined
+// up with the preds.
+static int split_edge(IrFunction& fn, int from, int to, vector<int>& layout_after)
+{
+    int mid = fn.new_block();
+    fn.blocks[mid].insts.push_back(IrInst{IrOp::BR});
+    fn.blocks[mid].preds.push_back(from);
+    fn.blocks[mid].succs.push_back(to);
+
+    for (auto& succ : fn.blocks[from].succs) {
+        if (succ == to) {
+            succ = mid;
+            break;
+        }
+    }
+    for (auto& pred : fn.blocks[to].preds) {
+        if (pred == from) {
+            pred = mid;
+            break;
+        }
+    }
+
+    layout_after.push_back(mid);
+    return mid;
+}
+
+void ir_split_critical_edges(IrFunction& fn)
+{
+    vector<int> layout, out_of_line;
+
+    for (size_t i = 0; i < fn.layout.size(); i++) {
+        int b = fn.layout[i];
+        layout.push_back(b);
+
+        if (fn.blocks[b].succs.size() < 2) {
+            continue;
+        }
+
+        int next = i + 1 < fn.layout.size() ? fn.layout[i + 1] : -1;
+        auto succs = fn.blocks[b].succs;
+        bool falls_through = std::find(succs.begin(), succs.end(), next) != succs.end();
+
+        vector<int> split;
+        for (size_t s = 0; s < succs.size(); s++) {
+            int to = succs[s];
+            auto& target = fn.blocks[to];
+
+            // (only edges into a PHI ever need moves placed on them - and
+            // a CBR has nowhere else to put them, however many preds the
+            // target has)
+            bool has_phi = !target.insts.empty() && target.insts[0].op == IrOp::PHI;
+            if (!has_phi) {
+                continue;
+            }
+
+            // the same target twice (cbr x, b1, b1) - split each edge
+            split_edge(fn, b, to, (falls_through && to != next) ? out_of_line : split);
+        }
+
+        // the false target of a cbr falls through, so it goes first
+        layout.insert(layout.end(), split.rbegin(), split.rend());
+    }
+
+    layout.insert(layout.end(), out_of_line.begin(), out_of_line.end());
+    fn.layout = std::move(layout);
+}
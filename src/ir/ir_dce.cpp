@@ -0,0 +1,273 @@
+#include "ir.h"
+
+// Dead code elimination
+//
+//  1. A CBR on a constant becomes a BR, & blocks that can't be reached
+//     from the entry are dropped (their edges into live blocks go too,
+//     with the matching PHI arguments). A block left with one pred has
+//     its PHIs turned into COPYs.
+//  2. Dead stores: a backward liveness pass over the variables. A
+//     STOREVAR whose variable is stored again (or the program ends) on
+//     every path before anything loads it is removed - this covers the
+//     zeroing store of a declaration the next assignment overwrites.
+//  3. Values nothing uses are removed, if computing them has no effect.
+//     A division only goes when its divisor is a constant it can't fault
+//     on.
+
+// drop the edge from -> to (& the PHI arguments that came along it)
+static void remove_edge(IrFunction& fn, int from, int to)
+{
+    auto& succs = fn.blocks[from].succs;
+    for (auto it = succs.begin(); it != succs.end(); it++) {
+        if (*it == to) {
+            succs.erase(it);
+            break;
+        }
+    }
+
+    auto& target = fn.blocks[to];
+    for (size_t i = 0; i < target.preds.size(); i++) {
+        if (target.preds[i] != from) {
+            continue;
+        }
+        target.preds.erase(target.preds.begin() + i);
+        for (auto& inst : target.insts) {
+            if (inst.op != IrOp::PHI) {
+                break;
+            }
+            inst.args.erase(inst.args.begin() + i);
+        }
+        break;
+    }
+}
+
+static void remove_unreachable(IrFunction& fn, const vector<bool>& is_const,
+                               const vector<int64_t>& value, DceStats& stats)
+{
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+        auto& term = block.insts.back();
+        if (term.op != IrOp::CBR || !is_const[term.args[0]]) {
+            continue;
+        }
+
+        int taken = value[term.args[0]] ? block.succs[0] : block.succs[1];
+        int dropped = value[term.args[0]] ? block.succs[1] : block.succs[0];
+        term = IrInst{IrOp::BR};
+        remove_edge(fn, b, dropped);
+        block.succs = {taken};
+        stats.branches++;
+    }
+
+    vector<bool> reachable(fn.blocks.size(), false);
+    vector<int> work = {fn.layout[0]};
+    reachable[fn.layout[0]] = true;
+    while (!work.empty()) {
+        int b = work.back();
+        work.pop_back();
+        for (int succ : fn.blocks[b].succs) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                work.push_back(succ);
+            }
+        }
+    }
+
+    vector<int> layout;
+    for (int b : fn.layout) {
+        if (reachable[b]) {
+            layout.push_back(b);
+            continue;
+        }
+
+        auto succs = fn.blocks[b].succs;
+        for (int succ : succs) {
+            if (reachable[succ]) {
+                remove_edge(fn, b, succ);
+            }
+        }
+        fn.blocks[b] = IrBlock{};
+        stats.blocks++;
+    }
+    fn.layout = std::move(layout);
+
+    // a PHI with one argument is just that value - & left as a PHI, its
+    // move would be lost if the pred ends in a CBR (only edges into blocks
+    // with several preds get a block for the moves)
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+        if (block.preds.size() != 1) {
+            continue;
+        }
+        for (auto& inst : block.insts) {
+            if (inst.op != IrOp::PHI) {
+                break;
+            }
+            inst.op = IrOp::COPY;
+        }
+    }
+}
+
+static void remove_dead_stores(IrFunction& fn, const vector<bool>& is_const,
+                               const vector<int64_t>& value, DceStats& stats)
+{
+    size_t nvars = fn.vars.size();
+    vector<vector<bool>> live_in(fn.blocks.size(), vector<bool>(nvars, false));
+
+    // variables live at the end of a block (nothing is live after RET)
+    auto live_out = [&](int b) {
+        vector<bool> live(nvars, false);
+        for (int succ : fn.blocks[b].succs) {
+            for (size_t v = 0; v < nvars; v++) {
+                live[v] = live[v] || live_in[succ][v];
+            }
+        }
+        return live;
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = fn.layout.rbegin(); it != fn.layout.rend(); it++) {
+            auto live = live_out(*it);
+            auto& insts = fn.blocks[*it].insts;
+            for (auto inst = insts.rbegin(); inst != insts.rend(); inst++) {
+                if (inst->op == IrOp::LOADVAR) {
+                    live[inst->imm] = true;
+                }
+                else if (inst->op == IrOp::STOREVAR) {
+                    live[inst->imm] = false;
+                }
+            }
+            if (live != live_in[*it]) {
+                live_in[*it] = std::move(live);
+                changed = true;
+            }
+        }
+    }
+
+    for (int b : fn.layout) {
+        auto live = live_out(b);
+        auto& insts = fn.blocks[b].insts;
+        vector<bool> dead(insts.size(), false);
+
+        for (size_t i = insts.size(); i-- > 0; ) {
+            auto& inst = insts[i];
+            if (inst.op == IrOp::LOADVAR) {
+                live[inst.imm] = true;
+            }
+            else if (inst.op == IrOp::STOREVAR) {
+                if (!live[inst.imm]) {
+                    dead[i] = true;
+                    stats.stores++;
+                    int val = inst.args[0];
+                    if (is_const[val] && value[val] == 0) {
+                        stats.zero_stores++;
+                    }
+                }
+                live[inst.imm] = false;
+            }
+        }
+
+        vector<IrInst> kept;
+        for (size_t i = 0; i < insts.size(); i++) {
+            if (!dead[i]) {
+                kept.push_back(std::move(insts[i]));
+            }
+        }
+        insts = std::move(kept);
+    }
+}
+
+// computing it does nothing but define its vreg
+static bool removable(const IrInst& inst, const vector<bool>& is_const, const vector<int64_t>& value)
+{
+    switch (inst.op) {
+    case IrOp::CONST:   case IrOp::LOADVAR:     case IrOp::ADD:
+    case IrOp::SUB:     case IrOp::MUL:         case IrOp::POW:
+    case IrOp::NEG:     case IrOp::CMP:         case IrOp::NOT:
+    case IrOp::PHI:     case IrOp::COPY:
+        return true;
+
+    case IrOp::DIV:
+    case IrOp::MOD: {
+        int divisor = inst.args[1];
+        return is_const[divisor] && value[divisor] != 0 && value[divisor] != -1;
+    }
+
+    default:
+        return false;
+    }
+}
+
+static void remove_dead_values(IrFunction& fn, const vector<bool>& is_const,
+                               const vector<int64_t>& value, DceStats& stats)
+{
+    vector<int> uses(fn.vregs.size(), 0);
+    vector<const IrInst*> def(fn.vregs.size(), nullptr);
+    for (int b : fn.layout) {
+        for (auto& inst : fn.blocks[b].insts) {
+            for (int arg : inst.args) {
+                uses[arg]++;
+            }
+            if (inst.dst >= 0) {
+                def[inst.dst] = &inst;
+            }
+        }
+    }
+
+    // removing one value can leave its operands unused in turn
+    vector<bool> dead(fn.vregs.size(), false);
+    vector<int> work;
+    for (size_t v = 0; v < fn.vregs.size(); v++) {
+        if (def[v] && uses[v] == 0) {
+            work.push_back(v);
+        }
+    }
+    while (!work.empty()) {
+        int v = work.back();
+        work.pop_back();
+        if (dead[v] || !removable(*def[v], is_const, value)) {
+            continue;
+        }
+
+        dead[v] = true;
+        if (def[v]->op != IrOp::CONST) {
+            stats.values++;
+        }
+        for (int arg : def[v]->args) {
+            if (--uses[arg] == 0 && def[arg]) {
+                work.push_back(arg);
+            }
+        }
+    }
+
+    for (int b : fn.layout) {
+        auto& insts = fn.blocks[b].insts;
+        vector<IrInst> kept;
+        for (auto& inst : insts) {
+            if (inst.dst < 0 || !dead[inst.dst]) {
+                kept.push_back(std::move(inst));
+            }
+        }
+        insts = std::move(kept);
+    }
+}
+
+void ir_eliminate_dead_code(IrFunction& fn, DceStats& stats)
+{
+    vector<bool> is_const(fn.vregs.size(), false);
+    vector<int64_t> value(fn.vregs.size(), 0);
+    for (auto& block : fn.blocks) {
+        for (auto& inst : block.insts) {
+            if (inst.op == IrOp::CONST) {
+                is_const[inst.dst] = true;
+                value[inst.dst] = inst.imm;
+            }
+        }
+    }
+
+    remove_unreachable(fn, is_const, value, stats);
+    remove_dead_stores(fn, is_const, value, stats);
+    remove_dead_values(fn, is_const, value, stats);
+}
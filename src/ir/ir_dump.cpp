@@ -0,0 +1,94 @@
+#include <iostream>
+
+#include "ir.h"
+
+using std::cout;
+
+// v3:i32 = add v1, v2
+static void dump_inst(const IrFunction& fn, const IrInst& inst, const IrBlock& block)
+{
+    cout << "    ";
+    if (inst.dst >= 0) {
+        cout << "v" << inst.dst << ":" << ir_type_name(fn.vregs[inst.dst]) << " = ";
+    }
+    cout << ir_op_name(inst.op);
+
+    switch (inst.op) {
+    case IrOp::CONST:
+        if (fn.vregs[inst.dst] == IrType::STR) {
+            cout << " \"" << reinterpret_cast<const char*>(inst.imm) << "\"";
+        }
+        else {
+            cout << " " << inst.imm;
+        }
+        break;
+
+    case IrOp::LOADVAR:
+        cout << " " << fn.vars[inst.imm].name;
+        break;
+
+    case IrOp::STOREVAR:
+        cout << " " << fn.vars[inst.imm].name << ", v" << inst.args[0];
+        break;
+
+    case IrOp::CMP:
+        cout << " v" << inst.args[0] << " " << ir_cmp_name(static_cast<IrCmp>(inst.imm)) << " v" << inst.args[1];
+        break;
+
+    case IrOp::PHI:
+        for (size_t i = 0; i < inst.args.size(); i++) {
+            cout << (i ? ", " : " ") << "[v" << inst.args[i] << ", b" << block.preds[i] << "]";
+        }
+        break;
+
+    case IrOp::BR:
+        cout << " b" << block.succs[0];
+        break;
+
+    case IrOp::CBR:
+        cout << " v" << inst.args[0] << ", b" << block.succs[0] << ", b" << block.succs[1];
+        break;
+
+    case IrOp::COUNT: {
+        auto& counter = fn.counters[inst.imm];
+        cout << " " << ir_counter_kind_name(counter.kind) << " " << counter.line << ":" << counter.col;
+        break;
+    }
+
+    default:
+        for (size_t i = 0; i < inst.args.size(); i++) {
+            cout << (i ? ", " : " ") << "v" << inst.args[i];
+        }
+        break;
+    }
+
+    cout << "\n";
+}
+
+void ir_dump(const IrFunction& fn)
+{
+    cout << "IR:\n";
+
+    for (int b : fn.layout) {
+        auto& block = fn.blocks[b];
+
+        cout << "  b" << b << ":";
+        if (!block.preds.empty()) {
+            cout << "    ; preds";
+            for (int pred : block.preds) {
+                cout << " b" << pred;
+            }
+        }
+        for (auto& loop : fn.loops) {
+            if (loop.header == b) {
+                cout << "    ; loop header (depth " << loop.depth << ", exit b" << loop.exit << ")";
+            }
+        }
+        cout << "\n";
+
+        for (auto& inst : block.insts) {
+            dump_inst(fn, inst, block);
+        }
+    }
+    cout << "\n";
+}
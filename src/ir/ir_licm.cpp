@@ -0,0 +1,115 @@
+#include "ir.h"
+
+// Loop invariant code motion
+//
+// An instruction in a loop (the condition included) whose operands are all
+// defined outside it computes the same value on every trip, so it moves to
+// the end of the loop's preheader - once, before the first test of the
+// condition. That repeats until nothing else qualifies, so whole invariant
+// subtrees move. Loops are done innermost first: what leaves an inner loop
+// lands in its preheader, inside the outer loop, & can move again from
+// there.
+//
+// Only instructions that can't have an effect move. The preheader always
+// runs, even when the loop body never does, so the one thing to keep out
+// is a fault: a division only moves when its divisor is a constant that
+// idiv can't fault on. A LOADVAR moves when the loop never stores the
+// variable (a read stores through STOREVAR, so that's covered).
+
+static bool hoistable(const IrInst& inst, const vector<bool>& is_const,
+                      const vector<int64_t>& value, const vector<bool>& stored)
+{
+    switch (inst.op) {
+    case IrOp::CONST:   case IrOp::ADD:     case IrOp::SUB:
+    case IrOp::MUL:     case IrOp::POW:     case IrOp::NEG:
+    case IrOp::CMP:     case IrOp::NOT:     case IrOp::COPY:
+        return true;
+
+    case IrOp::LOADVAR:
+        return !stored[inst.imm];
+
+    case IrOp::DIV:
+    case IrOp::MOD: {
+        int divisor = inst.args[1];
+        return is_const[divisor] && value[divisor] != 0 && value[divisor] != -1;
+    }
+
+    default:
+        return false;
+    }
+}
+
+void ir_hoist_invariants(IrFunction& fn, unsigned& hoisted)
+{
+    vector<bool> is_const(fn.vregs.size(), false);
+    vector<int64_t> value(fn.vregs.size(), 0);
+    for (auto& block : fn.blocks) {
+        for (auto& inst : block.insts) {
+            if (inst.op == IrOp::CONST) {
+                is_const[inst.dst] = true;
+                value[inst.dst] = inst.imm;
+            }
+        }
+    }
+
+    // (inner loops are entered after their outer loop)
+    for (auto loop = fn.loops.rbegin(); loop != fn.loops.rend(); loop++) {
+        vector<bool> defined_in(fn.vregs.size(), false);
+        vector<bool> stored(fn.vars.size(), false);
+
+        for (int b = loop->header; b < loop->end; b++) {
+            if (!loop->contains(b)) {
+                continue;
+            }
+            for (auto& inst : fn.blocks[b].insts) {
+                if (inst.dst >= 0) {
+                    defined_in[inst.dst] = true;
+                }
+                if (inst.op == IrOp::STOREVAR) {
+                    stored[inst.imm] = true;
+                }
+            }
+        }
+
+        vector<IrInst> moved;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (int b = loop->header; b < loop->end; b++) {
+                if (!loop->contains(b)) {
+                    continue;
+                }
+
+                auto& insts = fn.blocks[b].insts;
+                vector<IrInst> kept;
+                for (auto& inst : insts) {
+                    bool invariant = hoistable(inst, is_const, value, stored);
+                    for (size_t i = 0; invariant && i < inst.args.size(); i++) {
+                        invariant = !defined_in[inst.args[i]];
+                    }
+
+                    if (invariant) {
+                        defined_in[inst.dst] = false;
+                        moved.push_back(std::move(inst));
+                        changed = true;
+                    }
+                    else {
+                        kept.push_back(std::move(inst));
+                    }
+                }
+                insts = std::move(kept);
+            }
+        }
+
+        // constants are free to use anywhere - only count the real work
+        for (auto& inst : moved) {
+            if (inst.op != IrOp::CONST) {
+                hoisted++;
+            }
+        }
+
+        auto& pre = fn.blocks[loop->preheader].insts;
+        pre.insert(pre.end() - 1, moved.begin(), moved.end());
+    }
+}
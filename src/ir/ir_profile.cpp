@@ -0,0 +1,151 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "ir.h"
+
+using std::cout;
+
+// Profile guided lowering (--profile-use)
+//
+// The counts of an --instrument run decide three things:
+//
+//  - An if arm run under 1 in cold_arm_ratio of the if's runs (or
+//    never) is cold: its blocks move to the end of the code, so the code
+//    around it is one straight run. The branch into the arm is then the
+//    one that's taken - the backend inverts it, since it always falls
+//    through to whichever target comes next in the layout.
+//  - A loop whose body ran hot_loop_runs times or more is hot: its header
+//    is aligned to hot_loop_align.
+//  - A hot innermost loop is unrolled: 4 copies of the body per trip
+//    round the loop if it's small, 2 if it's not that small, each copy
+//    after its own test of the condition. A loop nest isn't (its copies
+//    would multiply), nor is an instrumented build (its counts would be
+//    split between the copies).
+//
+// Counts are matched by line:col, so a profile from an older version of
+// the source only gives worse guesses, never wrong code.
+
+static constexpr uint64_t cold_arm_ratio = 4;
+static constexpr uint64_t hot_loop_runs = 1000;
+
+// IR instructions (condition & body) of a small / not that small loop
+static constexpr size_t small_loop = 24;
+static constexpr size_t medium_loop = 64;
+
+bool ir_read_profile(const string& path, IrProfile& profile)
+{
+    std::ifstream file{path};
+    if (!file) {
+        cout << "ERROR: Could not read profile " << path << "\n";
+        return false;
+    }
+
+    string line;
+    if (!std::getline(file, line) || line.rfind("# ncc counts", 0) != 0) {
+        cout << "ERROR: " << path << " is not an ncc counts file (--instrument)\n";
+        return false;
+    }
+
+    int number = 1;
+    while (std::getline(file, line)) {
+        number++;
+        std::istringstream fields{line};
+        string kind;
+        int at_line, at_col;
+        uint64_t count;
+        if (!(fields >> kind >> at_line >> at_col >> count)) {
+            cout << "ERROR: " << path << ":" << number << ": bad record\n";
+            return false;
+        }
+
+        IrProfile::Position at{at_line, at_col};
+        if (kind == "stmt") {
+            profile.statements[at] = count;
+        }
+        else if (kind == "then") {
+            profile.then_arms[at] = count;
+        }
+        else if (kind == "else") {
+            profile.else_arms[at] = count;
+        }
+        else if (kind == "loop") {
+            profile.loop_bodies[at] = count;
+        }
+    }
+    return true;
+}
+
+void IrBuilder::use_profile(const IrProfile& counts, ProfileStats& stats)
+{
+    profile = &counts;
+    profile_stats = &stats;
+}
+
+bool IrBuilder::hot_loop(int at_line, int at_col) const
+{
+    if (profile == nullptr) {
+        return false;
+    }
+    auto it = profile->loop_bodies.find({at_line, at_col});
+    return it != profile->loop_bodies.end() && it->second >= hot_loop_runs;
+}
+
+void IrBuilder::arm(bool else_arm, int at_line, int at_col, int entry, int after)
+{
+    if (profile == nullptr) {
+        return;
+    }
+
+    auto& arms = else_arm ? profile->else_arms : profile->then_arms;
+    auto runs = profile->statements.find({at_line, at_col});
+    auto taken = arms.find({at_line, at_col});
+    if (runs == profile->statements.end() || taken == arms.end()) {
+        return;
+    }
+
+    if (taken->second * cold_arm_ratio < runs->second || taken->second == 0) {
+        fn.cold_arms.push_back(IrColdArm{entry, after});
+        profile_stats->cold_arms++;
+    }
+}
+
+int IrBuilder::loop_copies()
+{
+    size_t index = open_loops.back();
+    auto& loop = fn.loops[index];
+    if (instrumenting || index + 1 != fn.loops.size() || !hot_loop(loop.line, loop.col)) {
+        return 1;
+    }
+
+    size_t size = 0;
+    for (size_t b = loop.header; b < fn.blocks.size(); b++) {
+        size += fn.blocks[b].insts.size();
+    }
+
+    int copies = size <= small_loop ? 4 : size <= medium_loop ? 2 : 1;
+    if (copies > 1) {
+        profile_stats->unrolled++;
+        profile_stats->copies += copies - 1;
+    }
+    return copies;
+}
+
+// (a cold arm inside another one is in its stretch of the layout, so it
+// moves with it first & then again on its own)
+void ir_layout_cold_arms(IrFunction& fn)
+{
+    auto& layout = fn.layout;
+    for (auto& arm : fn.cold_arms) {
+        auto first = std::find(layout.begin(), layout.end(), arm.entry);
+        auto last = std::find(first, layout.end(), arm.after);
+        if (first == layout.end() || last == layout.end()) {
+            continue;   // (dead code elimination took part of it)
+        }
+
+        vector<int> moved(first, last);
+        layout.erase(first, last);
+        layout.insert(layout.end(), moved.begin(), moved.end());
+    }
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+
+#include "ir.h"
+
+// Loop variable promotion
+//
+// For each while loop (outermost first), the variables it loads & stores
+// most - uses in nested loops count 8x per level - are taken out of memory
+// for the duration of the loop: one LOADVAR in the preheader, the loop's
+// loads & stores become SSA values (with PHIs where control flow joins),
+// and one STOREVAR in the exit block if the loop writes the variable.
+//
+// The SSA values are built on demand, after Braun et al., "Simple and
+// Efficient Construction of Static Single Assignment Form": the value of a
+// variable at the start of a block is read from its predecessors, with a
+// PHI placed (before recursing, to cut cycles) where there are several &
+// dropped again when all its operands turn out to be the same value.
+// Every block of the loop is already known, so every block is sealed.
+
+namespace {
+
+// A block's PHIs come first (everything after the IR is built stops looking
+// for them at the first other instruction), so whatever goes at the start
+// of a block goes after them - an exit block with several preds can already
+// have PHIs from an outer loop's promotion, or get them from this one.
+vector<IrInst>::iterator after_phis(vector<IrInst>& insts)
+{
+    return std::find_if(insts.begin(), insts.end(), [](const IrInst& inst) {
+        return inst.op != IrOp::PHI;
+    });
+}
+
+class LoopPromoter {
+public:
+    LoopPromoter(IrFunction& fn, const IrLoop& loop, vector<int>& repl)
+        : fn{fn}, loop{loop}, repl{repl}, phis(fn.blocks.size())
+    {}
+
+    void promote(int var, bool written);
+    void insert_phis();
+
+private:
+    IrFunction& fn;
+    const IrLoop& loop;
+    vector<int>& repl;                  // vreg -> the vreg that replaces it (-1: none)
+    vector<vector<IrInst>> phis;        // new PHIs per block
+
+    int var = -1;
+    int initial = -1;                   // value loaded in the preheader
+    map<int, int> def_end;              // block -> last value stored in it
+    map<int, int> entry;                // block -> value at its start
+
+    int new_value();
+    int resolve(int);
+    int read_end(int block);
+    int read_entry(int block);
+    int new_phi(int block, const vector<int>& preds);
+};
+
+// (repl is kept as long as the vreg list)
+int LoopPromoter::new_value()
+{
+    int v = fn.new_vreg(IrType::I32);
+    repl.resize(fn.vregs.size(), -1);
+    return v;
+}
+
+int LoopPromoter::resolve(int v)
+{
+    while (repl[v] >= 0) {
+        v = repl[v];
+    }
+    return v;
+}
+
+int LoopPromoter::read_end(int block)
+{
+    if (block == loop.preheader) {
+        return initial;
+    }
+
+    auto it = def_end.find(block);
+    if (it != def_end.end()) {
+        return resolve(it->second);
+    }
+    return read_entry(block);
+}
+
+int LoopPromoter::read_entry(int block)
+{
+    auto it = entry.find(block);
+    if (it != entry.end()) {
+        return resolve(it->second);
+    }
+
+    auto& preds = fn.blocks[block].preds;
+    if (preds.size() == 1) {
+        int val = read_end(preds[0]);
+        entry[block] = val;
+        return val;
+    }
+    return new_phi(block, preds);
+}
+
+int LoopPromoter::new_phi(int block, const vector<int>& preds)
+{
+    int phi = new_value();
+    entry[block] = phi;
+
+    vector<int> args;
+    for (int pred : preds) {
+        args.push_back(read_end(pred));
+    }
+
+    // trivial - every operand is the same value (or the phi itself)
+    int same = -1;
+    bool trivial = true;
+    for (int arg : args) {
+        arg = resolve(arg);
+        if (arg == phi || arg == same) {
+            continue;
+        }
+        if (same >= 0) {
+            trivial = false;
+            break;
+        }
+        same = arg;
+    }
+
+    if (trivial && same >= 0) {
+        repl[phi] = same;
+        return same;
+    }
+
+    phis[block].push_back(IrInst{IrOp::PHI, phi, args});
+    return phi;
+}
+
+void LoopPromoter::promote(int v, bool written)
+{
+    var = v;
+    def_end.clear();
+    entry.clear();
+
+    // the value coming into the loop
+    auto& pre = fn.blocks[loop.preheader].insts;
+    initial = new_value();
+    pre.insert(pre.end() - 1, IrInst{IrOp::LOADVAR, initial, {}, var});
+
+    for (int b = loop.header; b < loop.end; b++) {
+        if (!loop.contains(b)) {
+            continue;
+        }
+        for (auto& inst : fn.blocks[b].insts) {
+            if (inst.op == IrOp::STOREVAR && inst.imm == var) {
+                def_end[b] = inst.args[0];
+            }
+        }
+    }
+
+    // loads become the current value, stores just change it
+    for (int b = loop.header; b < loop.end; b++) {
+        if (!loop.contains(b)) {
+            continue;
+        }
+
+        auto& insts = fn.blocks[b].insts;
+        vector<IrInst> kept;
+        int current = -1;
+
+        for (auto& inst : insts) {
+            if (inst.op == IrOp::LOADVAR && inst.imm == var) {
+                if (current < 0) {
+                    current = read_entry(b);
+                }
+                repl[inst.dst] = current;
+            }
+            else if (inst.op == IrOp::STOREVAR && inst.imm == var) {
+                current = inst.args[0];
+            }
+            else {
+                kept.push_back(std::move(inst));
+            }
+        }
+        insts = std::move(kept);
+    }
+
+    // the value going out of the loop
+    if (written) {
+        int exit = loop.exit;
+        auto& preds = fn.blocks[exit].preds;
+
+        int val = (preds.size() == 1) ? read_end(preds[0]) : read_entry(exit);
+        auto& insts = fn.blocks[exit].insts;
+        insts.insert(after_phis(insts), IrInst{IrOp::STOREVAR, -1, {val}, var});
+    }
+}
+
+void LoopPromoter::insert_phis()
+{
+    for (size_t b = 0; b < phis.size(); b++) {
+        auto& insts = fn.blocks[b].insts;
+        insts.insert(after_phis(insts), phis[b].begin(), phis[b].end());
+    }
+}
+
+} // namespace
+
+void ir_promote_loop_vars(IrFunction& fn, unsigned max_vars)
+{
+    if (max_vars == 0 || fn.loops.empty()) {
+        return;
+    }
+
+    // loop nesting depth of each block
+    vector<int> depth(fn.blocks.size(), 0);
+    for (auto& loop : fn.loops) {
+        for (int b = loop.header; b < loop.end; b++) {
+            if (loop.contains(b)) {
+                depth[b] = std::max(depth[b], loop.depth);
+            }
+        }
+    }
+
+    vector<int> repl(fn.vregs.size(), -1);
+
+    for (auto& loop : fn.loops) {
+        // weighted use counts of the variables still in memory in this loop
+        vector<long> count(fn.vars.size(), 0);
+        vector<bool> written(fn.vars.size(), false);
+
+        for (int b = loop.header; b < loop.end; b++) {
+            if (!loop.contains(b)) {
+                continue;
+            }
+
+            long weight = 1;
+            for (int d = loop.depth; d < depth[b] && weight < (1l << 30); d++) {
+                weight *= 8;
+            }
+
+            for (auto& inst : fn.blocks[b].insts) {
+                if (inst.op == IrOp::LOADVAR || inst.op == IrOp::STOREVAR) {
+                    count[inst.imm] += weight;
+                    written[inst.imm] = written[inst.imm] || inst.op == IrOp::STOREVAR;
+                }
+            }
+        }
+
+        vector<int> vars;
+        for (size_t v = 0; v < fn.vars.size(); v++) {
+            if (count[v] > 0) {
+                vars.push_back(v);
+            }
+        }
+        std::stable_sort(vars.begin(), vars.end(), [&](int a, int b) {
+            return count[a] > count[b];
+        });
+        if (vars.size() > max_vars) {
+            vars.resize(max_vars);
+        }
+
+        LoopPromoter promoter{fn, loop, repl};
+        for (int v : vars) {
+            promoter.promote(v, written[v]);
+        }
+        promoter.insert_phis();
+    }
+
+    // point every use at the value that replaced it
+    for (auto& block : fn.blocks) {
+        for (auto& inst : block.insts) {
+            for (auto& arg : inst.args) {
+                while (repl[arg] >= 0) {
+                    arg = repl[arg];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#include "ir.h"
+
+// Powers with a constant exponent
+//
+// The generic POW is a square-and-multiply loop. With the exponent known
+// the loop unrolls into its multiplies (left to right over the exponent's
+// bits): x ^ 5 = ((x * x) * (x * x)) * x is three muls, no branches.
+// Exponents up to max_exponent are done this way (at most 14 muls), a
+// negative exponent is 0 & x ^ 0 is 1, as the loop would give.
+
+static constexpr int64_t max_exponent = 255;
+
+void ir_reduce_powers(IrFunction& fn, StrengthStats& stats)
+{
+    // the value of each CONST vreg
+    vector<bool> is_const(fn.vregs.size(), false);
+    vector<int64_t> value(fn.vregs.size(), 0);
+    for (auto& block : fn.blocks) {
+        for (auto& inst : block.insts) {
+            if (inst.op == IrOp::CONST) {
+                is_const[inst.dst] = true;
+                value[inst.dst] = inst.imm;
+            }
+        }
+    }
+
+    for (auto& block : fn.blocks) {
+        vector<IrInst> insts;
+
+        for (auto& inst : block.insts) {
+            if (inst.op != IrOp::POW || !is_const[inst.args[1]] || value[inst.args[1]] > max_exponent) {
+                insts.push_back(std::move(inst));
+                continue;
+            }
+
+            stats.pow++;
+            int base = inst.args[0];
+            int64_t exp = value[inst.args[1]];
+
+            // (in the POW's place, from its source position)
+            auto replace = [&](IrOp op, int dst, vector<int> args, int64_t imm = 0) {
+                insts.push_back(IrInst{op, dst, std::move(args), imm, inst.line, inst.col, inst.region});
+            };
+
+            if (exp < 0) {
+                replace(IrOp::CONST, inst.dst, {}, 0);
+                continue;
+            }
+            if (exp == 0) {
+                replace(IrOp::CONST, inst.dst, {}, 1);
+                continue;
+            }
+            if (exp == 1) {
+                replace(IrOp::COPY, inst.dst, {base});
+                continue;
+            }
+
+            int top = 63 - __builtin_clzll(exp);
+            int acc = base;
+            for (int bit = top - 1; bit >= 0; bit--) {
+                bool multiply = (exp >> bit) & 1;
+
+                int square = (bit == 0 && !multiply) ? inst.dst : fn.new_vreg(IrType::I32);
+                replace(IrOp::MUL, square, {acc, acc});
+                acc = square;
+
+                if (multiply) {
+                    int product = (bit == 0) ? inst.dst : fn.new_vreg(IrType::I32);
+                    replace(IrOp::MUL, product, {acc, base});
+                    acc = product;
+                }
+            }
+        }
+
+        block.insts = std::move(insts);
+    }
+}
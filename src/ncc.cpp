@@ -6,18 +6,19 @@
 #include "parser.h"
 #include "cnode.h"
 #include "codegen.h"
+#include "options.h"
 
 using std::cout;
 
 int main(int argc, char **argv) {
-    // check if file arg is present
-    if (argc != 2) {
-        std::cout << "Usage: ncc /path/to/file\n";
+    // check options & that the file arg is present
+    Options opts{};
+    if (!parse_options(argc, argv, opts)) {
         return 1;
     }
 
     // initialize lex & buffer
-    Error err = lex_init(argv[1]);
+    Error err = lex_init(opts.filepath);
     if (err.id == NCC_FILE_NOT_FOUND) {
         print_error(err);
         return 1;
@@ -25,7 +26,7 @@ int main(int argc, char **argv) {
 
     SymbolTable symtbl{};
     Parser parser{symtbl};
-    Codegen codegen{parser, symtbl};
+    Codegen codegen{parser, symtbl, opts};
 
     auto codetree = parser.parse();
 
@@ -0,0 +1,167 @@
+#include <iostream>
+#include <string>
+
+#include "options.h"
+
+using std::cout, std::string;
+
+static void print_usage()
+{
+    cout << "Usage: ncc [options] /path/to/file\n"
+         << "Options:\n"
+         << "  --align-loops=N    align loop heads to N bytes (16 or 32)\n"
+         << "  --loop-regs=N      promote up to N (0-5) variables out of memory per loop\n"
+         << "  --no-fold          skip constant folding & propagation\n"
+         << "  --no-strength      skip strength reduction\n"
+         << "  --no-licm          skip loop invariant code motion\n"
+         << "  --no-dce           skip dead code & dead store elimination\n"
+         << "  --no-peephole      skip the peephole pass\n"
+         << "  --opt-report       print what the optimization passes did\n"
+         << "  --dump-ir          print the IR before code generation\n"
+         << "  --async-output     write program output on a separate thread\n"
+         << "  --output=FILE      write program output to FILE\n"
+         << "  --bench N          time N runs of the program (output discarded)\n"
+         << "  --counters[=json]  report hardware counters for the run & compile phases\n"
+         << "  --perf-map         write /tmp/perf-<pid>.map for the generated code\n"
+         << "  --jitdump          write a jitdump (symbols, code & lines) for perf\n"
+         << "  --profile[=HZ]     sample the run (HZ times a second) & report hot lines\n"
+         << "  --instrument[=FILE] count statements, if arms & loop runs (FILE: the counts)\n"
+         << "  --profile-use FILE lay out & unroll the code by an --instrument run's counts\n";
+}
+
+bool parse_options(int argc, char** argv, Options& opts)
+{
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg.rfind("--align-loops=", 0) == 0) {
+            string val = arg.substr(14);
+            if (val != "16" && val != "32") {
+                cout << "ERROR: --align-loops expects 16 or 32\n";
+                return false;
+            }
+            opts.loop_align = std::stoi(val);
+        }
+        else if (arg.rfind("--loop-regs=", 0) == 0) {
+            string val = arg.substr(12);
+            if (val.size() != 1 || val[0] < '0' || val[0] > '5') {
+                cout << "ERROR: --loop-regs expects 0 to 5\n";
+                return false;
+            }
+            opts.loop_regs = val[0] - '0';
+        }
+        else if (arg == "--no-fold") {
+            opts.fold = false;
+        }
+        else if (arg == "--no-strength") {
+            opts.strength_reduce = false;
+        }
+        else if (arg == "--no-licm") {
+            opts.licm = false;
+        }
+        else if (arg == "--no-dce") {
+            opts.dce = false;
+        }
+        else if (arg == "--no-peephole") {
+            opts.peephole = false;
+        }
+        else if (arg == "--opt-report") {
+            opts.opt_report = true;
+        }
+        else if (arg == "--dump-ir") {
+            opts.dump_ir = true;
+        }
+        else if (arg == "--async-output") {
+            opts.async_output = true;
+        }
+        else if (arg.rfind("--output=", 0) == 0) {
+            if (arg.size() == 9) {
+                cout << "ERROR: --output expects a file name\n";
+                return false;
+            }
+            opts.output_path = argv[i] + 9;
+        }
+        else if (arg == "--bench" || arg.rfind("--bench=", 0) == 0) {
+            string val;
+            if (arg.size() > 7) {
+                val = arg.substr(8);
+            }
+            else if (i + 1 < argc) {
+                val = argv[++i];
+            }
+            if (val.empty() || val.size() > 9 || val.find_first_not_of("0123456789") != string::npos
+                || std::stoi(val) == 0) {
+                cout << "ERROR: --bench expects a number of runs\n";
+                return false;
+            }
+            opts.bench = std::stoi(val);
+        }
+        else if (arg == "--counters") {
+            opts.counters = true;
+        }
+        else if (arg == "--counters=json") {
+            opts.counters = true;
+            opts.counters_json = true;
+        }
+        else if (arg == "--perf-map") {
+            opts.perf_map = true;
+        }
+        else if (arg == "--jitdump") {
+            opts.jitdump = true;
+        }
+        else if (arg == "--profile") {
+            opts.profile_hz = 1000;
+        }
+        else if (arg.rfind("--profile=", 0) == 0) {
+            string val = arg.substr(10);
+            if (val.empty() || val.size() > 5 || val.find_first_not_of("0123456789") != string::npos
+                || std::stoi(val) == 0 || std::stoi(val) > 10000) {
+                cout << "ERROR: --profile expects a rate from 1 to 10000 Hz\n";
+                return false;
+            }
+            opts.profile_hz = std::stoi(val);
+        }
+        else if (arg == "--instrument") {
+            opts.instrument = true;
+        }
+        else if (arg.rfind("--instrument=", 0) == 0) {
+            if (arg.size() == 13) {
+                cout << "ERROR: --instrument expects a file name\n";
+                return false;
+            }
+            opts.instrument = true;
+            opts.counts_path = argv[i] + 13;
+        }
+        else if (arg == "--profile-use" || arg.rfind("--profile-use=", 0) == 0) {
+            if (arg.size() > 13) {
+                opts.profile_use = argv[i] + 14;
+            }
+            else if (i + 1 < argc) {
+                opts.profile_use = argv[++i];
+            }
+            if (opts.profile_use == nullptr || *opts.profile_use == '\0') {
+                cout << "ERROR: --profile-use expects a counts file\n";
+                return false;
+            }
+        }
+        else if (arg.rfind("--", 0) == 0) {
+            cout << "ERROR: Unknown option " << arg << "\n";
+            print_usage();
+            return false;
+        }
+        else if (opts.filepath == nullptr) {
+            opts.filepath = argv[i];
+        }
+        else {
+            print_usage();
+            return false;
+        }
+    }
+
+    if (opts.filepath == nullptr) {
+        print_usage();
+        return false;
+    }
+
+    return true;
+}
@@ -35,30 +35,41 @@ unique_ptr<CNode> Parser::parse_stmt_block() {
 }
 
 
+// the statement starts at line:col
+static unique_ptr<CNode> at(unique_ptr<CNode> stmt, int line, int col)
+{
+    if (stmt != nullptr) {
+        stmt->set_position(line, col);
+    }
+    return stmt;
+}
+
+
 unique_ptr<CNode> Parser::parse_stmt() {
+    int line = tok.line;
+    int col  = tok.col;
+
     if (tok.id != TOKEN_IDENT) {
         print_error(Error{NCC_UNEXPECT_SYM, tok.line, tok.col});
         get_token(tok);
         return nullptr;
     }
-    else if (tok.string_val == "print")    {    get_token(tok);    return parse_print_stmt();    }
-    else if (tok.string_val == "read")     {    get_token(tok);    return parse_read_stmt();     }
-    else if (tok.string_val == "if")       {    get_token(tok);    return parse_if_stmt();       }
-    else if (tok.string_val == "while")    {    get_token(tok);    return parse_while_stmt();    }
+    else if (tok.string_val == "print")    {    get_token(tok);    return at(parse_print_stmt(), line, col);    }
+    else if (tok.string_val == "read")     {    get_token(tok);    return at(parse_read_stmt(), line, col);     }
+    else if (tok.string_val == "if")       {    get_token(tok);    return at(parse_if_stmt(), line, col);       }
+    else if (tok.string_val == "while")    {    get_token(tok);    return at(parse_while_stmt(), line, col);    }
 
     // if falls thru to here, either var assignment OR var declaration
     //   - first identifier does not yet determine the statement type
     string ident = tok.string_val;
-    int line = tok.line;
-    int col  = tok.col;
     get_token(tok);
 
     if (tok.id == TOKEN_ASSIGN) {
         get_token(tok);
-        return parse_varassig_stmt(ident, line, col);
+        return at(parse_varassig_stmt(ident, line, col), line, col);
     }
     else {
-        return parse_vardecl_stmt(ident, line, col);
+        return at(parse_vardecl_stmt(ident, line, col), line, col);
     }
 }
 
@@ -140,8 +151,10 @@ unique_ptr<CNode> Parser::parse_if_stmt()
 
     unique_ptr<CNode> else_stmt = nullptr;
     if (tok.id == TOKEN_IDENT && tok.string_val == "else") {
+        int line = tok.line;
+        int col  = tok.col;
         get_token(tok);
-        else_stmt = parse_else_stmt();
+        else_stmt = at(parse_else_stmt(), line, col);
     }
 
     return make_unique<IfNode>(std::move(expr_node), std::move(if_body), std::move(else_stmt));
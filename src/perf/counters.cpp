@@ -0,0 +1,173 @@
+#include <iostream>
+#include <iomanip>
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+using std::cout;
+
+struct CounterEvent {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static constexpr uint64_t cache_miss(uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// indexed by Counter
+static const CounterEvent events[COUNTER_COUNT] = {
+    {"cycles",          PERF_TYPE_HARDWARE,     PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions",    PERF_TYPE_HARDWARE,     PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses",   PERF_TYPE_HARDWARE,     PERF_COUNT_HW_BRANCH_MISSES},
+    {"L1-dcache-misses", PERF_TYPE_HW_CACHE,    cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+    {"L1-icache-misses", PERF_TYPE_HW_CACHE,    cache_miss(PERF_COUNT_HW_CACHE_L1I)},
+    {"iTLB-misses",     PERF_TYPE_HW_CACHE,     cache_miss(PERF_COUNT_HW_CACHE_ITLB)},
+    {"task-clock-ns",   PERF_TYPE_SOFTWARE,     PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults",     PERF_TYPE_SOFTWARE,     PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+// leader first
+static const vector<vector<Counter>> group_layout = {
+    {CYCLES, INSTRUCTIONS, BRANCH_MISSES},
+    {L1D_MISSES, L1I_MISSES, ITLB_MISSES},
+    {TASK_CLOCK, PAGE_FAULTS},
+};
+
+const char* counter_name(Counter counter)
+{
+    return events[counter].name;
+}
+
+double CounterValues::ipc() const
+{
+    if (!valid[CYCLES] || !valid[INSTRUCTIONS] || value[CYCLES] == 0) {
+        return 0;
+    }
+    return static_cast<double>(value[INSTRUCTIONS]) / value[CYCLES];
+}
+
+static int open_event(Counter counter, int group_fd)
+{
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.disabled = group_fd == -1;     // (the group follows its leader)
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (auto& group : groups) {
+        for (int fd : group.fds) {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::open()
+{
+    for (auto& layout : group_layout) {
+        int leader = open_event(layout[0], -1);
+        if (leader == -1) {
+            if (open_error.empty()) {
+                open_error = string{"perf_event_open: "} + std::strerror(errno);
+            }
+            continue;
+        }
+
+        Group group{leader, {leader}, {layout[0]}};
+        for (size_t i = 1; i < layout.size(); i++) {
+            int fd = open_event(layout[i], leader);
+            if (fd != -1) {
+                group.fds.push_back(fd);
+                group.counters.push_back(layout[i]);
+            }
+        }
+        groups.push_back(std::move(group));
+    }
+    return available();
+}
+
+void PerfCounters::start()
+{
+    for (auto& group : groups) {
+        ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+CounterValues PerfCounters::stop()
+{
+    for (auto& group : groups) {
+        ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    CounterValues values;
+    for (auto& group : groups) {
+        // { nr, time_enabled, time_running, value[nr] }
+        uint64_t data[3 + COUNTER_COUNT];
+        ssize_t n = read(group.leader, data, sizeof(data));
+        if (n < static_cast<ssize_t>(3 * sizeof(uint64_t)) || data[0] != group.counters.size()) {
+            continue;
+        }
+
+        uint64_t enabled = data[1], running = data[2];
+        if (running == 0) {
+            continue;   // (never got on the PMU)
+        }
+        for (size_t i = 0; i < group.counters.size(); i++) {
+            uint64_t value = data[3 + i];
+            if (running < enabled) {
+                value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+            }
+            values.value[group.counters[i]] = value;
+            values.valid[group.counters[i]] = true;
+        }
+    }
+    return values;
+}
+
+void print_counters(const CounterValues& values, const string& indent)
+{
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (!values.valid[c]) {
+            continue;
+        }
+        cout << indent << std::left << std::setw(18) << counter_name(Counter(c)) << std::right
+             << std::setw(16) << values.value[c] << "\n";
+        if (c == INSTRUCTIONS && values.valid[CYCLES]) {
+            cout << indent << std::left << std::setw(18) << "IPC" << std::right
+                 << std::setw(16) << std::fixed << std::setprecision(2) << values.ipc()
+                 << std::defaultfloat << std::setprecision(6) << "\n";
+        }
+    }
+}
+
+void print_counters_json(const CounterValues& values)
+{
+    cout << "{";
+    const char* sep = "";
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        if (values.valid[c]) {
+            cout << sep << "\"" << counter_name(Counter(c)) << "\": " << values.value[c];
+            sep = ", ";
+        }
+    }
+    if (values.valid[CYCLES] && values.valid[INSTRUCTIONS]) {
+        cout << sep << "\"ipc\": " << values.ipc();
+    }
+    cout << "}";
+}
@@ -0,0 +1,233 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <elf.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "jitsyms.h"
+
+using std::cout;
+
+vector<JitSymbol> jit_symbols(const vector<SourceRange>& ranges, const vector<IrRegion>& regions,
+                              size_t code_size, const string& file)
+{
+    auto name_of = [&](const SourceRange& range) {
+        if (range.region < 0) {
+            return file + ":entry";
+        }
+        auto& region = regions[range.region];
+        return file + ":" + std::to_string(region.line) + (region.loop_body ? ":loop" : "");
+    };
+
+    // (statements sharing a line share a symbol)
+    vector<JitSymbol> symbols;
+    for (auto& range : ranges) {
+        if (range.start == range.end) {
+            continue;
+        }
+        string name = name_of(range);
+        if (!symbols.empty() && symbols.back().name == name && symbols.back().end == range.start) {
+            symbols.back().end = range.end;
+            continue;
+        }
+        symbols.push_back(JitSymbol{range.start, range.end, std::move(name)});
+    }
+
+    // the runtime helper trampolines, after the code
+    size_t end = ranges.empty() ? 0 : ranges.back().end;
+    if (end < code_size) {
+        symbols.push_back(JitSymbol{end, code_size, file + ":trampolines"});
+    }
+    return symbols;
+}
+
+vector<LineEntry> line_table(const vector<SourceRange>& ranges)
+{
+    vector<LineEntry> lines;
+    for (auto& range : ranges) {
+        if (range.start == range.end) {
+            continue;
+        }
+        if (!lines.empty() && lines.back().line == range.line && lines.back().col == range.col) {
+            continue;
+        }
+        lines.push_back(LineEntry{static_cast<uint32_t>(range.start), range.line, range.col});
+    }
+    if (!ranges.empty()) {
+        lines.push_back(LineEntry{static_cast<uint32_t>(ranges.back().end), 0, 0});
+    }
+    return lines;
+}
+
+const LineEntry* find_line(const vector<LineEntry>& lines, size_t at)
+{
+    auto it = std::upper_bound(lines.begin(), lines.end(), at, [](size_t offset, const LineEntry& entry) {
+        return offset < entry.offset;
+    });
+    return it == lines.begin() ? nullptr : &*(it - 1);
+}
+
+void write_perf_map(const uint8_t* code, const vector<JitSymbol>& symbols)
+{
+    string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+    FILE* map = std::fopen(path.c_str(), "w");
+    if (map == nullptr) {
+        cout << "ERROR: Could not write " << path << "\n";
+        return;
+    }
+    for (auto& symbol : symbols) {
+        std::fprintf(map, "%lx %lx %s\n", reinterpret_cast<uintptr_t>(code + symbol.start),
+                     symbol.end - symbol.start, symbol.name.c_str());
+    }
+    std::fclose(map);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  JITDUMP                                  //
+///////////////////////////////////////////////////////////////////////////////
+
+// The format perf's jitdump support reads (tools/perf/util/jitdump.h): a
+// file header, then records - each symbol's line table (DEBUG_INFO) goes
+// right before the symbol (CODE_LOAD). Timestamps are CLOCK_MONOTONIC, what
+// perf record -k mono uses.
+
+static constexpr uint32_t jitdump_magic = 0x4A695444;     // "JiTD"
+static constexpr uint32_t jitdump_version = 1;
+
+enum JitRecord : uint32_t {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_DEBUG_INFO = 2
+};
+
+static uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// records are packed, so they're built byte by byte
+struct DumpWriter {
+    vector<uint8_t> bytes;
+
+    template<typename T>
+    void put(T value)
+    {
+        auto p = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void put_string(const string& text)
+    {
+        bytes.insert(bytes.end(), text.begin(), text.end());
+        bytes.push_back(0);
+    }
+
+    // the header of a record whose body follows - returns where its size goes
+    size_t begin_record(JitRecord id)
+    {
+        put<uint32_t>(id);
+        size_t at = bytes.size();
+        put<uint32_t>(0);
+        put<uint64_t>(monotonic_ns());
+        return at - 4;
+    }
+
+    void end_record(size_t start)
+    {
+        uint32_t size = bytes.size() - start;
+        std::memcpy(&bytes[start + 4], &size, 4);
+    }
+};
+
+void write_jitdump(const uint8_t* code, const vector<JitSymbol>& symbols,
+                   const vector<SourceRange>& ranges, const string& source_path)
+{
+    const char* dir = std::getenv("JITDUMPDIR");
+    string path = string{dir ? dir : "/tmp"} + "/jit-" + std::to_string(getpid()) + ".dump";
+
+    int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd == -1) {
+        cout << "ERROR: Could not write " << path << "\n";
+        return;
+    }
+
+    // perf finds the dump by this mapping (left in place until exit)
+    if (mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0) == MAP_FAILED) {
+        cout << "ERROR: Could not map " << path << "\n";
+        close(fd);
+        return;
+    }
+
+    char resolved[PATH_MAX];
+    string source = realpath(source_path.c_str(), resolved) ? resolved : source_path;
+
+    DumpWriter dump;
+    uint32_t pid = getpid();
+    uint32_t tid = syscall(SYS_gettid);
+
+    dump.put<uint32_t>(jitdump_magic);
+    dump.put<uint32_t>(jitdump_version);
+    dump.put<uint32_t>(40);                 // header size
+    dump.put<uint32_t>(EM_X86_64);
+    dump.put<uint32_t>(0);
+    dump.put<uint32_t>(pid);
+    dump.put<uint64_t>(monotonic_ns());
+    dump.put<uint64_t>(0);                  // flags
+
+    for (size_t i = 0; i < symbols.size(); i++) {
+        auto& symbol = symbols[i];
+        uint64_t addr = reinterpret_cast<uintptr_t>(code + symbol.start);
+
+        vector<const SourceRange*> lines;
+        for (auto& range : ranges) {
+            if (range.line > 0 && range.start < range.end
+                && range.start >= symbol.start && range.start < symbol.end) {
+                lines.push_back(&range);
+            }
+        }
+        if (!lines.empty()) {
+            size_t record = dump.begin_record(JIT_CODE_DEBUG_INFO);
+            dump.put<uint64_t>(addr);
+            dump.put<uint64_t>(lines.size());
+            for (auto range : lines) {
+                dump.put<uint64_t>(reinterpret_cast<uintptr_t>(code + range->start));
+                dump.put<int32_t>(range->line);
+                dump.put<int32_t>(0);       // discriminator
+                dump.put_string(source);
+            }
+            dump.end_record(record);
+        }
+
+        size_t record = dump.begin_record(JIT_CODE_LOAD);
+        dump.put<uint32_t>(pid);
+        dump.put<uint32_t>(tid);
+        dump.put<uint64_t>(addr);           // vma
+        dump.put<uint64_t>(addr);           // code address
+        dump.put<uint64_t>(symbol.end - symbol.start);
+        dump.put<uint64_t>(i);              // code index
+        dump.put_string(symbol.name);
+        dump.bytes.insert(dump.bytes.end(), code + symbol.start, code + symbol.end);
+        dump.end_record(record);
+    }
+
+    const uint8_t* p = dump.bytes.data();
+    size_t left = dump.bytes.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n <= 0) {
+            cout << "ERROR: Could not write " << path << "\n";
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    close(fd);
+}
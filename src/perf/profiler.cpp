@@ -0,0 +1,173 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include "profiler.h"
+#include "bufio.h"
+
+using std::cout, std::string;
+
+// how far up the stack (in words) to look for a call from the code
+static constexpr int stack_search = 256;
+
+// call rel32
+static constexpr size_t call_len = 5;
+
+static Profiler* active = nullptr;
+static struct sigaction old_action;
+
+Profiler::Profiler(const uint8_t* code, size_t code_size)
+    : code{code}
+    , code_size{code_size}
+    , in_code(code_size)
+    , in_helpers(code_size)
+{
+}
+
+Profiler::~Profiler()
+{
+    stop();
+}
+
+// (runs in the signal handler - no allocating, no locks)
+void Profiler::on_sample(int, siginfo_t*, void* context)
+{
+    Profiler* self = active;
+    if (self == nullptr) {
+        return;
+    }
+
+    auto& regs = static_cast<ucontext_t*>(context)->uc_mcontext.gregs;
+    auto base = reinterpret_cast<uintptr_t>(self->code);
+    uintptr_t pc = regs[REG_RIP];
+    if (pc - base < self->code_size) {
+        self->in_code[pc - base]++;
+        return;
+    }
+
+    // the innermost return address just past a call in the code
+    auto sp = reinterpret_cast<const uintptr_t*>(regs[REG_RSP]);
+    for (int i = 0; i < stack_search; i++) {
+        uintptr_t ret = sp[i] - base;
+        if (ret >= call_len && ret <= self->code_size && self->code[ret - call_len] == 0xe8) {
+            self->in_helpers[ret - call_len]++;
+            return;
+        }
+    }
+    self->elsewhere++;
+}
+
+bool Profiler::start(unsigned sample_hz)
+{
+    if (active != nullptr) {
+        return false;
+    }
+
+    struct sigaction action{};
+    action.sa_sigaction = on_sample;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &old_action) == -1) {
+        cout << "ERROR: Could not install the SIGPROF handler\n";
+        return false;
+    }
+
+    hz = sample_hz;
+    active = this;
+
+    itimerval timer{};
+    timer.it_interval.tv_usec = 1000000 / hz;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr) == -1) {
+        cout << "ERROR: Could not start the profiling timer\n";
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void Profiler::stop()
+{
+    if (active != this) {
+        return;
+    }
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &old_action, nullptr);
+    active = nullptr;
+}
+
+// the line, trimmed to fit the report
+static string excerpt(int line)
+{
+    static constexpr size_t width = 48;
+
+    string text = buf_getline(line);
+    size_t first = text.find_first_not_of(" \t");
+    size_t last = text.find_last_not_of(" \t\r\n");
+    if (first == string::npos) {
+        return "";
+    }
+    text = text.substr(first, last - first + 1);
+    if (text.size() > width) {
+        text = text.substr(0, width - 3) + "...";
+    }
+    return text;
+}
+
+void Profiler::report(const vector<LineEntry>& lines) const
+{
+    struct LineSamples {
+        uint64_t total = 0;
+        uint64_t helpers = 0;
+    };
+
+    std::map<int, LineSamples> by_line;
+    uint64_t code_total = 0, helper_total = 0;
+    for (size_t at = 0; at < code_size; at++) {
+        if (in_code[at] == 0 && in_helpers[at] == 0) {
+            continue;
+        }
+        const LineEntry* entry = find_line(lines, at);
+        auto& samples = by_line[entry ? entry->line : 0];
+        samples.total += in_code[at] + in_helpers[at];
+        samples.helpers += in_helpers[at];
+        code_total += in_code[at];
+        helper_total += in_helpers[at];
+    }
+
+    vector<std::pair<int, LineSamples>> hot(by_line.begin(), by_line.end());
+    std::stable_sort(hot.begin(), hot.end(), [](auto& a, auto& b) {
+        return a.second.total > b.second.total;
+    });
+
+    uint64_t total = code_total + helper_total + elsewhere;
+    cout << "Profile: " << total << " samples at " << hz << " Hz ("
+         << code_total << " in the code, " << helper_total << " in runtime helpers, "
+         << elsewhere << " elsewhere)\n";
+    if (total == 0) {
+        return;
+    }
+
+    cout << "  " << std::setw(6) << "line" << std::setw(10) << "samples" << std::setw(8) << "%"
+         << std::setw(10) << "helpers" << "  source\n";
+    cout << std::fixed << std::setprecision(1);
+    for (auto& [line, samples] : hot) {
+        cout << "  " << std::setw(6);
+        if (line > 0) {
+            cout << line;
+        }
+        else {
+            cout << "-";
+        }
+        cout << std::setw(10) << samples.total
+             << std::setw(7) << 100.0 * samples.total / total << "%"
+             << std::setw(10) << samples.helpers << "  "
+             << (line > 0 ? excerpt(line) : "(entry & trampolines)") << "\n";
+    }
+    cout << std::defaultfloat << std::setprecision(6);
+}
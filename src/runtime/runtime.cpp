@@ -0,0 +1,524 @@
+#include <iostream>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "runtime.h"
+
+using std::cout;
+
+///////////////////////////////////////////////////////////////////////////////
+//                                  OUTPUT                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+static constexpr size_t out_capacity = 1 << 20;
+
+static char first_buf[out_capacity];
+static char* out_buf = first_buf;   // the buffer being filled
+static size_t out_len = 0;
+
+// "00" "01" ... "99" - two digits per lookup
+static constexpr auto digit_pairs = [] {
+    std::array<char, 200> pairs{};
+    for (int i = 0; i < 100; i++) {
+        pairs[2 * i] = '0' + i / 10;
+        pairs[2 * i + 1] = '0' + i % 10;
+    }
+    return pairs;
+}();
+
+// longest int4: "-2147483648"
+static constexpr size_t max_int_len = 11;
+
+// ============================== //
+//              Sink              //
+// ============================== //
+
+// stdout, or a file mapped into memory (grown by doubling, cut to size when
+// the program is done) - or nowhere, when benchmarking
+static bool sink_discard = false;
+static int sink_fd = STDOUT_FILENO;
+static char* sink_map = nullptr;
+static size_t sink_len = 0, sink_capacity = 0;
+
+static void sink_open(const char* path)
+{
+    sink_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (sink_fd == -1) {
+        cout << "ERROR: Could not open output file " << path << "\n";
+        std::exit(1);
+    }
+    sink_capacity = out_capacity;
+    sink_len = 0;
+    if (ftruncate(sink_fd, sink_capacity) == -1
+        || (sink_map = static_cast<char*>(mmap(0, sink_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, sink_fd, 0))) == MAP_FAILED) {
+        cout << "ERROR: Could not map output file " << path << "\n";
+        std::exit(1);
+    }
+}
+
+static void sink_write(const char* text, size_t n)
+{
+    if (sink_discard) {
+        return;
+    }
+    if (sink_map != nullptr) {
+        if (sink_len + n > sink_capacity) {
+            size_t capacity = sink_capacity;
+            while (capacity < sink_len + n) {
+                capacity *= 2;
+            }
+            void* mem = MAP_FAILED;
+            if (ftruncate(sink_fd, capacity) == 0) {
+                mem = mremap(sink_map, sink_capacity, capacity, MREMAP_MAYMOVE);
+            }
+            if (mem == MAP_FAILED) {
+                cout << "ERROR: Could not grow the output file\n";
+                std::exit(1);
+            }
+            sink_map = static_cast<char*>(mem);
+            sink_capacity = capacity;
+        }
+        std::memcpy(sink_map + sink_len, text, n);
+        sink_len += n;
+        return;
+    }
+
+    while (n > 0) {
+        ssize_t written = write(sink_fd, text, n);
+        if (written <= 0) {
+            return;
+        }
+        text += written;
+        n -= written;
+    }
+}
+
+static void sink_close()
+{
+    if (sink_map != nullptr) {
+        munmap(sink_map, sink_capacity);
+        if (ftruncate(sink_fd, sink_len) == -1) {
+            cout << "ERROR: Could not truncate the output file\n";
+        }
+        close(sink_fd);
+        sink_map = nullptr;
+    }
+    sink_fd = STDOUT_FILENO;
+}
+
+// ============================== //
+//             Writer             //
+// ============================== //
+
+// Async output: the buffers form a ring the program fills in order & the
+// writer thread drains in order. `submitted` & `written` count buffers
+// (single producer, single consumer - the counters are the whole queue),
+// & a buffer is only filled again once it's been written.
+static constexpr size_t out_buffers = 4;
+
+static bool async_output = false;
+static std::thread writer;
+static char* ring[out_buffers];
+static size_t ring_len[out_buffers];
+static std::atomic<uint64_t> submitted{0}, written{0};
+static std::atomic<bool> stopping{false};
+
+static void writer_loop()
+{
+    uint64_t done = 0;
+    for (;;) {
+        uint64_t ready = submitted.load(std::memory_order_acquire);
+        while (ready == done) {
+            submitted.wait(ready, std::memory_order_acquire);
+            ready = submitted.load(std::memory_order_acquire);
+        }
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        for (; done < ready; done++) {
+            sink_write(ring[done % out_buffers], ring_len[done % out_buffers]);
+            written.store(done + 1, std::memory_order_release);
+            written.notify_one();
+        }
+    }
+}
+
+// until the writer has caught up to `count` buffers
+static void wait_written(uint64_t count)
+{
+    uint64_t done = written.load(std::memory_order_acquire);
+    while (done < count) {
+        written.wait(done, std::memory_order_acquire);
+        done = written.load(std::memory_order_acquire);
+    }
+}
+
+// the buffer being filled is done with - out now, or queued for the writer
+// (then the next one in the ring is filled, once it's free)
+static void submit()
+{
+    if (out_len == 0) {
+        return;
+    }
+    if (!async_output) {
+        sink_write(out_buf, out_len);
+        out_len = 0;
+        return;
+    }
+
+    uint64_t next = submitted.load(std::memory_order_relaxed);
+    ring_len[next % out_buffers] = out_len;
+    submitted.store(next + 1, std::memory_order_release);
+    submitted.notify_one();
+
+    // (the next buffer was last used out_buffers submissions ago)
+    if (next + 1 >= out_buffers) {
+        wait_written(next + 2 - out_buffers);
+    }
+    out_buf = ring[(next + 1) % out_buffers];
+    out_len = 0;
+}
+
+void runtime_output(bool async, const char* path, bool discard)
+{
+    sink_discard = discard;
+    if (path != nullptr && !discard) {
+        sink_open(path);
+    }
+
+    async_output = async;
+    if (async) {
+        ring[0] = first_buf;
+        for (size_t i = 1; i < out_buffers; i++) {
+            ring[i] = new char[out_capacity];
+        }
+        submitted = 0;
+        written = 0;
+        stopping = false;
+
+        // (the thread starts with SIGPROF blocked - profiler samples are
+        // for the program's thread)
+        sigset_t prof, old;
+        sigemptyset(&prof);
+        sigaddset(&prof, SIGPROF);
+        pthread_sigmask(SIG_BLOCK, &prof, &old);
+        writer = std::thread(writer_loop);
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+    out_buf = first_buf;
+    out_len = 0;
+}
+
+void runtime_flush()
+{
+    submit();
+    if (async_output) {
+        wait_written(submitted.load(std::memory_order_relaxed));
+    }
+}
+
+void runtime_finish()
+{
+    runtime_flush();
+
+    if (async_output) {
+        stopping.store(true, std::memory_order_release);
+        submitted.fetch_add(1, std::memory_order_release);
+        submitted.notify_one();
+        writer.join();
+
+        for (size_t i = 1; i < out_buffers; i++) {
+            delete[] ring[i];
+        }
+        async_output = false;
+    }
+    out_buf = first_buf;
+
+    sink_close();
+    sink_discard = false;
+}
+
+static void reserve(size_t n)
+{
+    if (out_len + n > out_capacity) {
+        submit();
+    }
+}
+
+static void append(const char* text, size_t n)
+{
+    // (too big to ever fit - straight out, after everything before it)
+    if (n > out_capacity) {
+        runtime_flush();
+        sink_write(text, n);
+        return;
+    }
+    reserve(n);
+    std::memcpy(out_buf + out_len, text, n);
+    out_len += n;
+}
+
+// digits are written back to front into a small scratch area, two at a
+// time, then copied to `out` - returns the end of what was written
+static char* format_int(char* out, int32_t v)
+{
+    char digits[max_int_len];
+    char* end = digits + max_int_len;
+    char* p = end;
+
+    uint32_t u = v < 0 ? 0u - static_cast<uint32_t>(v) : static_cast<uint32_t>(v);
+    while (u >= 100) {
+        uint32_t pair = u % 100;
+        u /= 100;
+        p -= 2;
+        std::memcpy(p, &digit_pairs[2 * pair], 2);
+    }
+    if (u >= 10) {
+        p -= 2;
+        std::memcpy(p, &digit_pairs[2 * u], 2);
+    }
+    else {
+        *--p = '0' + u;
+    }
+    if (v < 0) {
+        *--p = '-';
+    }
+
+    std::memcpy(out, p, end - p);
+    return out + (end - p);
+}
+
+static const char* arg_text(const PrintDesc* desc, const PrintArg& arg)
+{
+    return reinterpret_cast<const char*>(desc) + arg.value;
+}
+
+// the whole statement goes in with one bounds check - unless it has a
+// string only known at run time, or might not fit at all
+void print_list(const PrintDesc* desc)
+{
+    auto args = reinterpret_cast<const PrintArg*>(desc + 1);
+
+    if (desc->max_len > out_capacity) {
+        for (uint32_t i = 0; i < desc->count; i++) {
+            auto& arg = args[i];
+            switch (arg.tag) {
+            case PRINT_TEXT:
+                append(arg_text(desc, arg), arg.len);
+                break;
+            case PRINT_INT:
+                reserve(max_int_len);
+                out_len = format_int(out_buf + out_len, static_cast<int32_t>(arg.value)) - out_buf;
+                break;
+            case PRINT_BOOL:
+                arg.value ? append("true", 4) : append("false", 5);
+                break;
+            case PRINT_STR: {
+                auto text = reinterpret_cast<const char*>(arg.value);
+                append(text, std::strlen(text));
+                break;
+            }
+            }
+        }
+        return;
+    }
+
+    reserve(desc->max_len);
+    char* out = out_buf + out_len;
+    for (uint32_t i = 0; i < desc->count; i++) {
+        auto& arg = args[i];
+        switch (arg.tag) {
+        case PRINT_TEXT:
+            std::memcpy(out, arg_text(desc, arg), arg.len);
+            out += arg.len;
+            break;
+        case PRINT_INT:
+            out = format_int(out, static_cast<int32_t>(arg.value));
+            break;
+        case PRINT_BOOL:
+            out = arg.value ? static_cast<char*>(std::memcpy(out, "true", 4)) + 4
+                            : static_cast<char*>(std::memcpy(out, "false", 5)) + 5;
+            break;
+        }
+    }
+    out_len = out - out_buf;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                   INPUT                                   //
+///////////////////////////////////////////////////////////////////////////////
+
+// Input
+//
+// stdin is mmapped whole when it's a regular file, otherwise read in big
+// chunks (a number split across two chunks is moved to the front before
+// the next one goes in after it). Numbers are parsed 8 digits at a time
+// with SWAR arithmetic on a 64-bit load. Running out of input, or finding
+// something that isn't an int4, ends the program with an error - output
+// so far is written first. What's been printed is handed off before each
+// read, so a prompt goes out before the program waits on it.
+
+static constexpr size_t in_capacity = 1 << 16;
+
+static char in_buf[in_capacity];
+static const char* in_pos = in_buf;
+static const char* in_end = in_buf;
+static bool in_eof = false;
+static bool in_started = false;
+
+static void start_input()
+{
+    in_started = true;
+
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mem = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+        if (mem != MAP_FAILED) {
+            in_pos = static_cast<const char*>(mem);
+            in_end = in_pos + st.st_size;
+            in_eof = true;
+        }
+    }
+}
+
+void runtime_input(const char* text, size_t n)
+{
+    in_started = true;
+    in_pos = text;
+    in_end = text + n;
+    in_eof = true;
+}
+
+// keep [keep, in_end), read more after it - false at the end of input
+static bool refill(const char*& keep)
+{
+    if (in_eof) {
+        return false;
+    }
+
+    size_t kept = in_end - keep;
+    std::memmove(in_buf, keep, kept);
+    keep = in_buf;
+    in_end = in_buf + kept;
+
+    ssize_t n = read(STDIN_FILENO, in_buf + kept, in_capacity - kept);
+    if (n <= 0) {
+        in_eof = true;
+        return false;
+    }
+    in_end += n;
+    return true;
+}
+
+[[noreturn]] static void input_error(const char* what)
+{
+    runtime_finish();
+    cout << "ERROR: read() " << what << "\n" << std::flush;
+    std::exit(1);
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_digit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+// 8 ASCII digits (first digit in the low byte) -> their value
+static uint32_t parse_eight(const char* digits)
+{
+    uint64_t v;
+    std::memcpy(&v, digits, 8);
+    v -= 0x3030303030303030;
+    v = (v * 10) + (v >> 8);                                    // pairs
+    v = (((v & 0x000000ff000000ff) * (100 + (1000000ull << 32)))
+       + (((v >> 16) & 0x000000ff000000ff) * (1 + (10000ull << 32)))) >> 32;
+    return static_cast<uint32_t>(v);
+}
+
+int32_t read_int4()
+{
+    // (the program may have prompted for this - no need to wait on it)
+    submit();
+    if (!in_started) {
+        start_input();
+    }
+
+    // whitespace
+    for (;;) {
+        while (in_pos < in_end && is_space(*in_pos)) {
+            in_pos++;
+        }
+        if (in_pos < in_end) {
+            break;
+        }
+        if (!refill(in_pos)) {
+            input_error("ran out of input");
+        }
+    }
+
+    // the whole number has to be in the buffer
+    const char* p;
+    for (;;) {
+        p = in_pos;
+        if (p < in_end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        while (p < in_end && is_digit(*p)) {
+            p++;
+        }
+        if (p < in_end) {
+            break;
+        }
+        if (!refill(in_pos)) {
+            p = in_end;
+            break;
+        }
+    }
+
+    const char* digits = in_pos;
+    bool negative = false;
+    if (*digits == '-' || *digits == '+') {
+        negative = *digits == '-';
+        digits++;
+    }
+    if (digits == p) {
+        input_error("expected an int4");
+    }
+    in_pos = p;
+
+    while (digits < p - 1 && *digits == '0') {
+        digits++;
+    }
+    if (p - digits > 10) {
+        input_error("got a value out of int4 range");
+    }
+
+    uint64_t value = 0;
+    if (p - digits >= 8) {
+        value = parse_eight(digits);
+        digits += 8;
+    }
+    while (digits < p) {
+        value = value * 10 + (*digits++ - '0');
+    }
+
+    if (value > (negative ? 2147483648ull : 2147483647ull)) {
+        input_error("got a value out of int4 range");
+    }
+    return negative ? static_cast<int32_t>(0u - static_cast<uint32_t>(value)) : static_cast<int32_t>(value);
+}